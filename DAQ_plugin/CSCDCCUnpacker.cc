@@ -10,6 +10,7 @@
 #include "FWCore/Framework/interface/ConsumesCollector.h"
 #include "FWCore/Framework/interface/stream/EDProducer.h"
 #include "FWCore/Framework/interface/ESHandle.h"
+#include "FWCore/Framework/interface/ESWatcher.h"
 #include "FWCore/Framework/interface/EventSetup.h"
 #include "FWCore/MessageLogger/interface/MessageLogger.h"
 #include "FWCore/ParameterSet/interface/ConfigurationDescriptions.h"
@@ -17,6 +18,7 @@
 #include "FWCore/ParameterSet/interface/ParameterSet.h"
 #include "FWCore/Utilities/interface/InputTag.h"
 #include "FWCore/Utilities/interface/ESGetToken.h"
+#include "FWCore/Utilities/interface/Exception.h"
 #include "FWCore/ServiceRegistry/interface/Service.h"
 
 #include "CondFormats/CSCObjects/interface/CSCCrateMap.h"
@@ -52,6 +54,8 @@
 #include "EventFilter/CSCRawToDigi/interface/CSCEventData.h"
 #include "EventFilter/CSCRawToDigi/interface/CSCTMBData.h"
 #include "EventFilter/CSCRawToDigi/interface/CSCDCCEventData.h"
+#include "EventFilter/CSCRawToDigi/interface/CSCDDUEventData.h"
+#include "EventFilter/CSCRawToDigi/interface/CSCDCCExaminer.h"
 #include "EventFilter/CSCRawToDigi/interface/CSCCFEBData.h"
 #include "EventFilter/CSCRawToDigi/interface/CSCGEMData.h"
 #include "EventFilter/CSCRawToDigi/interface/CSCMonitorInterface.h"
@@ -61,29 +65,301 @@
 #include <string>
 #include <iomanip>
 #include <cstdio>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <algorithm>
+#include <bitset>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 class CSCMonitorInterface;
 
-class CSCDCCUnpacker : public edm::stream::EDProducer<> {
+namespace cscdccunpacker {
+
+  /// Cheap timestamp for per-stage accounting: TSC ticks on x86, steady_clock ticks elsewhere
+  inline uint64_t stageClock() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+  }
+
+  enum Stage { kExaminerCheck = 0, kDDUDecode, kChamberDecode, kDigiInsert, kNumStages };
+  constexpr const char* stageNames[kNumStages] = {"examinerCheck", "dduDecode", "chamberDecode", "digiInsert"};
+
+  /// All CSC FED ids (DCCs 750-757 and DDUs 830-869) fit in one range
+  constexpr unsigned int kFirstFED = FEDNumbering::MINCSCFEDID;
+  constexpr unsigned int kNumFEDs = FEDNumbering::MAXCSCDDUFEDID - FEDNumbering::MINCSCFEDID + 1;
+  /// Examiner error word is 32 bits wide, nERRORS itself is not a compile time constant
+  constexpr unsigned int kNumErrorBits = 32;
+  /// DDU error slots: one per CSC FED id plus an overflow slot for unexpected DDU ids
+  constexpr unsigned int kNumDDUSlots = kNumFEDs + 1;
+  /// Chamber error slots indexed by the examiner CSCIdType (crate << 4 | dmb), crates 0-60 plus an overflow slot
+  constexpr unsigned int kNumChamberSlots = 61 * 16 + 1;
+
+  // Post-LS1 FED/DDU ID mapping fix
+  constexpr unsigned int postLS1_map[] = {841, 842, 843, 844, 845, 846, 847, 848, 849, 831, 832, 833,
+                                          834, 835, 836, 837, 838, 839, 861, 862, 863, 864, 865, 866,
+                                          867, 868, 869, 851, 852, 853, 854, 855, 856, 857, 858, 859};
+
+  /// DDU id as reported by the examiner -> error slot. Pre-LS1 DDU numbers 1-36 go through postLS1_map.
+  inline unsigned int dduSlot(unsigned int dduId) {
+    if (dduId >= 1 && dduId <= 36)
+      dduId = postLS1_map[dduId - 1];
+    if (dduId >= kFirstFED && dduId < kFirstFED + kNumFEDs)
+      return dduId - kFirstFED;
+    return kNumDDUSlots - 1;
+  }
+
+  /// Examiner chamber id (crate << 4 | dmb) -> error slot
+  inline unsigned int chamberSlot(unsigned int cscId) {
+    return cscId < kNumChamberSlots - 1 ? cscId : kNumChamberSlots - 1;
+  }
+
+  /// Calls f(bit) for every set bit of an examiner status word
+  template <typename F>
+  inline void forEachBit(uint32_t word, F&& f) {
+    while (word) {
+      f(__builtin_ctz(word));
+      word &= word - 1;
+    }
+  }
+
+  /// Per-stream counters, only ever touched by the stream that owns them
+  struct StreamStats {
+    uint64_t ticks[kNumStages] = {};
+    uint64_t calls[kNumStages] = {};
+    uint64_t fedBytes[kNumFEDs] = {};
+    uint64_t fedCount[kNumFEDs] = {};
+    uint64_t fedRejected[kNumFEDs] = {};
+    uint64_t rejectedBits[kNumErrorBits] = {};
+    uint64_t events = 0;
+    // Error accounting mode, per examiner error bit
+    uint64_t fedErrorBits[kNumFEDs][kNumErrorBits] = {};
+    uint64_t dduErrorBits[kNumDDUSlots][kNumErrorBits] = {};
+    uint64_t chamberErrorBits[kNumChamberSlots][kNumErrorBits] = {};
+    /// Detailed records (log lines and format status digis) already emitted per error bit
+    uint64_t detailRecords[kNumErrorBits] = {};
+  };
+
+  /// Job-wide sums. Streams add into it once at endStream, so atomics are enough and no lock is needed.
+  struct GlobalStats {
+    explicit GlobalStats(const std::string& file) : csvFile(file) {}
+    void add(const StreamStats& s) const;
+    const std::string csvFile;
+    mutable std::atomic<uint64_t> ticks[kNumStages] = {};
+    mutable std::atomic<uint64_t> calls[kNumStages] = {};
+    mutable std::atomic<uint64_t> fedBytes[kNumFEDs] = {};
+    mutable std::atomic<uint64_t> fedCount[kNumFEDs] = {};
+    mutable std::atomic<uint64_t> fedRejected[kNumFEDs] = {};
+    mutable std::atomic<uint64_t> rejectedBits[kNumErrorBits] = {};
+    mutable std::atomic<uint64_t> events{0};
+    mutable std::atomic<uint64_t> fedErrorBits[kNumFEDs][kNumErrorBits] = {};
+    mutable std::atomic<uint64_t> dduErrorBits[kNumDDUSlots][kNumErrorBits] = {};
+    mutable std::atomic<uint64_t> chamberErrorBits[kNumChamberSlots][kNumErrorBits] = {};
+  };
+
+  void GlobalStats::add(const StreamStats& s) const {
+    for (unsigned int i = 0; i < kNumStages; ++i) {
+      ticks[i] += s.ticks[i];
+      calls[i] += s.calls[i];
+    }
+    for (unsigned int i = 0; i < kNumFEDs; ++i) {
+      fedBytes[i] += s.fedBytes[i];
+      fedCount[i] += s.fedCount[i];
+      fedRejected[i] += s.fedRejected[i];
+    }
+    for (unsigned int i = 0; i < kNumErrorBits; ++i)
+      rejectedBits[i] += s.rejectedBits[i];
+    events += s.events;
+    // Most slots stay empty, skip the atomic adds for them
+    for (unsigned int bit = 0; bit < kNumErrorBits; ++bit) {
+      for (unsigned int i = 0; i < kNumFEDs; ++i)
+        if (s.fedErrorBits[i][bit])
+          fedErrorBits[i][bit] += s.fedErrorBits[i][bit];
+      for (unsigned int i = 0; i < kNumDDUSlots; ++i)
+        if (s.dduErrorBits[i][bit])
+          dduErrorBits[i][bit] += s.dduErrorBits[i][bit];
+      for (unsigned int i = 0; i < kNumChamberSlots; ++i)
+        if (s.chamberErrorBits[i][bit])
+          chamberErrorBits[i][bit] += s.chamberErrorBits[i][bit];
+    }
+  }
+
+  /// Adds the ticks spent in its scope to one stage
+  class StageTimer {
+  public:
+    StageTimer(StreamStats& stats, Stage stage) : stats_(stats), stage_(stage), start_(stageClock()) {}
+    ~StageTimer() {
+      stats_.ticks[stage_] += stageClock() - start_;
+      ++stats_.calls[stage_];
+    }
+
+  private:
+    StreamStats& stats_;
+    const Stage stage_;
+    const uint64_t start_;
+  };
+
+  /// Region of interest: readout crates, DMB slots, CFEBs and layers to unpack. An empty list selects everything.
+  /// Crate and DMB are the readout ids from the DMB header (examiner CSCIdType), not the mapped chamber.
+  class RegionOfInterest {
+  public:
+    explicit RegionOfInterest(const edm::ParameterSet& pset) {
+      fill(fedIds_, pset.getParameter<std::vector<unsigned int>>("ROIFEDs"), kFirstFED);
+      fill(crates_, pset.getParameter<std::vector<unsigned int>>("ROICrates"));
+      fill(dmbs_, pset.getParameter<std::vector<unsigned int>>("ROIDMBs"));
+      fill(cfebs_, pset.getParameter<std::vector<unsigned int>>("ROICFEBs"));
+      fill(layers_, pset.getParameter<std::vector<unsigned int>>("ROILayers"));
+    }
+
+    bool selectsFED(unsigned int id) const { return id >= kFirstFED && fedIds_.test(id - kFirstFED); }
+    bool selectsChamber(int crate, int dmb) const {
+      return crates_.test(crate & 0xFF) && dmbs_.test(dmb & 0xF);
+    }
+    /// Same, for the examiner chamber id (crate << 4 | dmb)
+    bool selectsChamber(CSCIdType cscId) const { return cscId >= 0 && selectsChamber(cscId >> 4, cscId & 0xF); }
+    bool selectsCFEB(int cfeb) const { return cfebs_.test(cfeb); }
+    bool selectsLayer(int layer) const { return layers_.test(layer); }
+
+    /// True if some chambers are left out, only then is the per chamber selection worth doing
+    bool restrictsChambers() const { return !crates_.all() || !dmbs_.all(); }
+
+  private:
+    template <size_t N>
+    static void fill(std::bitset<N>& bits, const std::vector<unsigned int>& list, unsigned int offset = 0) {
+      if (list.empty()) {
+        bits.set();
+        return;
+      }
+      for (unsigned int value : list) {
+        if (value < offset || value - offset >= N)
+          throw cms::Exception("Configuration") << "CSCDCCUnpacker: ROI value " << value << " out of range";
+        bits.set(value - offset);
+      }
+    }
+
+    std::bitset<kNumFEDs> fedIds_;
+    std::bitset<256> crates_;
+    std::bitset<16> dmbs_;
+    std::bitset<CSCConstants::MAX_CFEBS_RUN2> cfebs_;
+    std::bitset<7> layers_;  // layers 1-6
+  };
+
+  /// Moves decoded LCTs into their collection. With suppressZero the invalid ones are dropped in place, so no second
+  /// filtered vector is built, and chambers without any LCT left get no (empty) entry in the collection.
+  template <typename Collection, typename Digi>
+  void emitLCTs(Collection& product, std::vector<Digi>& digis, const CSCDetId& layer, bool suppressZero, bool debug) {
+    if (suppressZero) {
+      digis.erase(std::remove_if(digis.begin(), digis.end(), [](const Digi& digi) { return !digi.isValid(); }),
+                  digis.end());
+      if (debug) {
+        for (const Digi& digi : digis)
+          LogTrace("CSCDCCUnpacker|CSCRawToDigi") << digi << std::endl;
+      }
+    }
+    if (!digis.empty())
+      product.move(std::make_pair(digis.begin(), digis.end()), layer);
+  }
+
+  /// Readout (crate, dmb, cfeb, layer) -> CSCDetId, and chamber -> FED/DDU id it is expected in (post-LS1 numbering).
+  /// Flat tables filled from CSCCrateMap/CSCChamberMap on first use, reset() whenever either record changes.
+  class ChamberLookup {
+  public:
+    ChamberLookup() : detIds_(kNumCrates * kNumDMBs * kNumCFEBs * kNumLayers, 0), dduIds_(kNumCrates * kNumDMBs, 0) {}
+
+    void reset() {
+      std::fill(detIds_.begin(), detIds_.end(), 0);
+      std::fill(dduIds_.begin(), dduIds_.end(), 0);
+    }
+
+    /// crate 1-60 and dmb 1-10 must already be checked, layer 0 is the whole chamber
+    CSCDetId detId(const CSCCrateMap& crateMap, int crate, int dmb, int cfeb, int layer) {
+      if (cfeb < 0 || cfeb >= kNumCFEBs)
+        return crateMap.detId(crate, dmb, cfeb, layer);
+      // rawId 0 is never a valid CSCDetId, so it marks entries not looked up yet
+      uint32_t& raw = detIds_[((chamberIndex(crate, dmb) * kNumCFEBs) + cfeb) * kNumLayers + layer];
+      if (raw == 0)
+        raw = crateMap.detId(crate, dmb, cfeb, layer).rawId();
+      return CSCDetId(raw);
+    }
+
+    unsigned int expectedDDU(const CSCCrateMap& crateMap, const CSCChamberMap& chamberMap, int crate, int dmb) {
+      unsigned int& ddu = dduIds_[chamberIndex(crate, dmb)];
+      if (ddu == 0) {
+        ddu = chamberMap.ddu(detId(crateMap, crate, dmb, 0, 0));
+        if ((ddu >= 1) && (ddu <= 36))
+          ddu = postLS1_map[ddu - 1];  // Fix for Post-LS1 FED/DDU IDs mappings
+      }
+      return ddu;
+    }
+
+  private:
+    static constexpr int kNumCrates = 60, kNumDMBs = 10, kNumCFEBs = CSCConstants::MAX_CFEBS_RUN2, kNumLayers = 7;
+    static size_t chamberIndex(int crate, int dmb) { return (crate - 1) * kNumDMBs + (dmb - 1); }
+
+    std::vector<uint32_t> detIds_;
+    std::vector<unsigned int> dduIds_;
+  };
+
+  /// One DDU decoded in region of interest mode: DDU header/trailer copies and only the selected chambers
+  struct DDUBlock {
+    CSCDDUHeader header;
+    CSCDDUTrailer trailer;
+    uint16_t trailer0 = 0;
+    std::vector<CSCEventData> chambers;
+  };
+
+}  // namespace cscdccunpacker
+
+class CSCDCCUnpacker : public edm::stream::EDProducer<edm::GlobalCache<cscdccunpacker::GlobalStats>> {
 public:
   /// Constructor
-  CSCDCCUnpacker(const edm::ParameterSet& pset);
+  CSCDCCUnpacker(const edm::ParameterSet& pset, const cscdccunpacker::GlobalStats*);
 
   /// Destructor
   ~CSCDCCUnpacker() override;
 
   static void fillDescriptions(edm::ConfigurationDescriptions& descriptions);
 
+  static std::unique_ptr<cscdccunpacker::GlobalStats> initializeGlobalCache(const edm::ParameterSet& pset);
+  /// Dump the stage timing, per-FED byte counts, examiner rejection reasons and error summary of all streams
+  static void globalEndJob(const cscdccunpacker::GlobalStats* stats);
+
   /// Produce digis out of raw data
   void produce(edm::Event& e, const edm::EventSetup& c) override;
 
+  /// Hand this stream's counters over to the global sums
+  void endStream() override;
+
   /// Visualization of raw data in FED-less events (Robert Harr and Alexander Sakharov)
   void visual_raw(int hl, int id, int run, int event, bool fedshort, bool fDump, short unsigned int* buf) const;
 
 private:
+  /// Error accounting mode: count the examiner errors of one FED into the fixed per-bit arrays.
+  /// Returns true if one of the error bits is still below errorDetailLimit, i.e. detailed records should be kept.
+  bool countExaminerErrors(unsigned int fedIndex, const CSCDCCExaminer& examiner);
+
+  /// Region of interest decode of a DDU FED: builds CSCEventData only for the selected chambers, straight from the
+  /// chamber offsets the examiner found, instead of constructing CSCDDUEventData for the whole DDU. Chambers with
+  /// examiner errors are only dropped with UseSelectiveUnpacking, same as the full decode.
+  /// Returns false if the examiner did not find exactly one DDU, the caller then falls back to the full decode.
+  bool unpackRegionOfInterest(const FEDRawData& fedData,
+                              const CSCDCCExaminer& examiner,
+                              cscdccunpacker::DDUBlock& ddu) const;
+
   bool debug, printEventNumber, goodEvent, useExaminer, unpackStatusDigis;
   bool useSelectiveUnpacking, useFormatStatus;
 
+  /// status digi collections actually produced, subset of UnpackStatusDigis chosen by StatusDigiProducts
+  bool unpackCFEBStatus, unpackDMBStatus, unpackTMBStatus, unpackALCTStatus, unpackDDUStatus, unpackDCCStatus;
+
   /// option to unpack RPC data
   bool useRPCs_;
 
@@ -98,6 +374,11 @@ private:
   /// Suppress zeros LCTs
   bool SuppressZeroLCT;
 
+  /// Count examiner errors per FED/DDU/chamber instead of logging and storing every erroneous FED
+  bool errorSummaryMode;
+  /// In errorSummaryMode, how many detailed records (log lines, format status digis) to keep per error bit
+  unsigned int errorDetailLimit;
+
   int numOfEvents;
   unsigned int errorMask, examinerMask;
   bool instantiateDQM;
@@ -105,15 +386,27 @@ private:
   bool disableMappingCheck, b904Setup;
   int b904vmecrate, b904dmb;
 
+  /// Readout slots, CFEBs and layers to unpack, everything by default
+  const cscdccunpacker::RegionOfInterest roi_;
+
   CSCMonitorInterface* monitor;
 
+  /// Cached readout -> CSCDetId/DDU mapping, rebuilt when the crate or chamber map changes
+  cscdccunpacker::ChamberLookup chamberLookup_;
+  edm::ESWatcher<CSCCrateMapRcd> crateMapWatcher_;
+  edm::ESWatcher<CSCChamberMapRcd> chamberMapWatcher_;
+
+  /// Always-on instrumentation for this stream
+  cscdccunpacker::StreamStats stats_;
+
   /// Token for consumes interface & access to data
   edm::EDGetTokenT<FEDRawDataCollection> i_token;
   edm::ESGetToken<CSCCrateMap, CSCCrateMapRcd> crateToken;
   edm::ESGetToken<CSCChamberMap, CSCChamberMapRcd> cscmapToken;
 };
 
-CSCDCCUnpacker::CSCDCCUnpacker(const edm::ParameterSet& pset) : numOfEvents(0) {
+CSCDCCUnpacker::CSCDCCUnpacker(const edm::ParameterSet& pset, const cscdccunpacker::GlobalStats*)
+    : numOfEvents(0), roi_(pset) {
   // Tracked
   i_token = consumes<FEDRawDataCollection>(pset.getParameter<edm::InputTag>("InputObjects"));
   crateToken = esConsumes<CSCCrateMap, CSCCrateMapRcd>();
@@ -125,6 +418,17 @@ CSCDCCUnpacker::CSCDCCUnpacker(const edm::ParameterSet& pset) : numOfEvents(0) {
   useSelectiveUnpacking = pset.getParameter<bool>("UseSelectiveUnpacking");
   errorMask = pset.getParameter<unsigned int>("ErrorMask");
   unpackStatusDigis = pset.getParameter<bool>("UnpackStatusDigis");
+  /// Only build the status collections somebody reads (see python/customiseCSCUnpackerProducts.py)
+  const std::vector<std::string> statusProducts = pset.getParameter<std::vector<std::string>>("StatusDigiProducts");
+  auto wantStatus = [&](const char* name) {
+    return unpackStatusDigis && std::find(statusProducts.begin(), statusProducts.end(), name) != statusProducts.end();
+  };
+  unpackCFEBStatus = wantStatus("CFEB");
+  unpackDMBStatus = wantStatus("DMB");
+  unpackTMBStatus = wantStatus("TMB");
+  unpackALCTStatus = wantStatus("ALCT");
+  unpackDDUStatus = wantStatus("DDU");
+  unpackDCCStatus = wantStatus("DCC");
   /// Enable Format Status Digis
   useFormatStatus = pset.getParameter<bool>("UseFormatStatus");
 
@@ -152,6 +456,9 @@ CSCDCCUnpacker::CSCDCCUnpacker(const edm::ParameterSet& pset) : numOfEvents(0) {
   /// Suppress zeros LCTs
   SuppressZeroLCT = pset.getUntrackedParameter<bool>("SuppressZeroLCT", true);
 
+  errorSummaryMode = pset.getUntrackedParameter<bool>("ErrorSummaryMode", false);
+  errorDetailLimit = pset.getUntrackedParameter<unsigned int>("ErrorDetailLimit", 10);
+
   if (instantiateDQM) {
     monitor = edm::Service<CSCMonitorInterface>().operator->();
   }
@@ -163,14 +470,18 @@ CSCDCCUnpacker::CSCDCCUnpacker(const edm::ParameterSet& pset) : numOfEvents(0) {
   produces<CSCCLCTDigiCollection>("MuonCSCCLCTDigi");
   produces<CSCCorrelatedLCTDigiCollection>("MuonCSCCorrelatedLCTDigi");
 
-  if (unpackStatusDigis) {
+  if (unpackCFEBStatus)
     produces<CSCCFEBStatusDigiCollection>("MuonCSCCFEBStatusDigi");
+  if (unpackTMBStatus)
     produces<CSCTMBStatusDigiCollection>("MuonCSCTMBStatusDigi");
+  if (unpackDMBStatus)
     produces<CSCDMBStatusDigiCollection>("MuonCSCDMBStatusDigi");
+  if (unpackALCTStatus)
     produces<CSCALCTStatusDigiCollection>("MuonCSCALCTStatusDigi");
+  if (unpackDDUStatus)
     produces<CSCDDUStatusDigiCollection>("MuonCSCDDUStatusDigi");
+  if (unpackDCCStatus)
     produces<CSCDCCStatusDigiCollection>("MuonCSCDCCStatusDigi");
-  }
 
   if (useFormatStatus) {
     produces<CSCDCCFormatStatusDigiCollection>("MuonCSCDCCFormatStatusDigi");
@@ -207,6 +518,128 @@ CSCDCCUnpacker::~CSCDCCUnpacker() {
   //fill destructor here
 }
 
+std::unique_ptr<cscdccunpacker::GlobalStats> CSCDCCUnpacker::initializeGlobalCache(const edm::ParameterSet& pset) {
+  return std::make_unique<cscdccunpacker::GlobalStats>(pset.getUntrackedParameter<std::string>("StatsCSVFile", ""));
+}
+
+void CSCDCCUnpacker::endStream() { globalCache()->add(stats_); }
+
+bool CSCDCCUnpacker::unpackRegionOfInterest(const FEDRawData& fedData,
+                                            const CSCDCCExaminer& examiner,
+                                            cscdccunpacker::DDUBlock& ddu) const {
+  const auto dmbBlocks = examiner.DMB_block();
+  if (dmbBlocks.size() != 1)
+    return false;
+
+  // A DDU FED holds exactly one DDU: header at the start of the FED, trailer at the end
+  const uint16_t* buf = reinterpret_cast<const uint16_t*>(fedData.data());
+  const size_t words = fedData.size() / 2;
+  if (words < CSCDDUHeader::sizeInWords() + CSCDDUTrailer::sizeInWords())
+    return false;
+  memcpy(&ddu.header, buf, CSCDDUHeader::sizeInWords() * 2);
+  const uint16_t* trailerBuf = buf + words - CSCDDUTrailer::sizeInWords();
+  memcpy(&ddu.trailer, trailerBuf, CSCDDUTrailer::sizeInWords() * 2);
+  // first trailer word carries the TTS state, same as CSCDDUEventData::trailer0()
+  ddu.trailer0 = trailerBuf[0];
+
+  // Same format version rule as CSCDDUEventData
+  const uint16_t formatVersion = (ddu.header.format_version() >= 0x6) ? 2013 : 2005;
+
+  ddu.chambers.clear();
+  for (const auto& dmb : dmbBlocks.begin()->second) {
+    if (!roi_.selectsChamber(dmb.first))
+      continue;
+    // Selective unpacking: skip chambers with errors, as CSCDDUEventData does when it is given the examiner
+    if (useSelectiveUnpacking && (examiner.errorsForChamber(dmb.first) & examiner.getMask()))
+      continue;
+    ddu.chambers.emplace_back(const_cast<uint16_t*>(dmb.second), formatVersion);
+  }
+  return true;
+}
+
+bool CSCDCCUnpacker::countExaminerErrors(unsigned int fedIndex, const CSCDCCExaminer& examiner) {
+  using namespace cscdccunpacker;
+  const uint32_t errors = examiner.errors();
+  bool keepDetails = false;
+  forEachBit(errors, [&](int bit) {
+    ++stats_.fedErrorBits[fedIndex][bit];
+    if (stats_.detailRecords[bit] < errorDetailLimit) {
+      ++stats_.detailRecords[bit];
+      keepDetails = true;
+    }
+  });
+  for (const auto& ddu : examiner.errorsDetailedDDU()) {
+    const unsigned int slot = dduSlot(ddu.first);
+    forEachBit(ddu.second, [&](int bit) { ++stats_.dduErrorBits[slot][bit]; });
+  }
+  for (const auto& chamber : examiner.errorsDetailed()) {
+    const unsigned int slot = chamberSlot(chamber.first);
+    forEachBit(chamber.second, [&](int bit) { ++stats_.chamberErrorBits[slot][bit]; });
+  }
+  return keepDetails;
+}
+
+void CSCDCCUnpacker::globalEndJob(const cscdccunpacker::GlobalStats* stats) {
+  using namespace cscdccunpacker;
+  // Examiner only to look up error names
+  CSCDCCExaminer names;
+
+  std::ostringstream csv;
+  csv << "section,name,count,ticks,ticks_per_count\n";
+  csv << "events,all," << stats->events << ",0,0\n";
+  for (unsigned int i = 0; i < kNumStages; ++i) {
+    const uint64_t calls = stats->calls[i], ticks = stats->ticks[i];
+    csv << "stage," << stageNames[i] << "," << calls << "," << ticks << "," << (calls ? ticks / calls : 0) << "\n";
+  }
+  for (unsigned int i = 0; i < kNumFEDs; ++i) {
+    if (stats->fedCount[i] == 0)
+      continue;
+    const uint64_t count = stats->fedCount[i], bytes = stats->fedBytes[i];
+    csv << "fedBytes," << kFirstFED + i << "," << count << "," << bytes << "," << bytes / count << "\n";
+    csv << "fedRejected," << kFirstFED + i << "," << stats->fedRejected[i] << ",0,0\n";
+  }
+  for (int i = 0; i < names.nERRORS && i < static_cast<int>(kNumErrorBits); ++i) {
+    if (stats->rejectedBits[i] != 0)
+      csv << "rejected,\"" << names.errName(i) << "\"," << stats->rejectedBits[i] << ",0,0\n";
+  }
+
+  // Error summary histogram (only filled in ErrorSummaryMode), one row per non-empty (slot, bit) bin
+  for (int bit = 0; bit < names.nERRORS && bit < static_cast<int>(kNumErrorBits); ++bit) {
+    for (unsigned int i = 0; i < kNumFEDs; ++i) {
+      if (stats->fedErrorBits[i][bit] != 0)
+        csv << "fedErrors,\"" << kFirstFED + i << ":" << names.errName(bit) << "\"," << stats->fedErrorBits[i][bit]
+            << ",0,0\n";
+    }
+    for (unsigned int i = 0; i < kNumDDUSlots; ++i) {
+      if (stats->dduErrorBits[i][bit] != 0) {
+        csv << "dduErrors,\"";
+        if (i < kNumFEDs)
+          csv << kFirstFED + i;
+        else
+          csv << "other";
+        csv << ":" << names.errName(bit) << "\"," << stats->dduErrorBits[i][bit] << ",0,0\n";
+      }
+    }
+    for (unsigned int i = 0; i < kNumChamberSlots; ++i) {
+      if (stats->chamberErrorBits[i][bit] != 0) {
+        csv << "chamberErrors,\"";
+        if (i < kNumChamberSlots - 1)
+          csv << "crate" << (i >> 4) << "/dmb" << (i & 0xF);
+        else
+          csv << "other";
+        csv << ":" << names.errName(bit) << "\"," << stats->chamberErrorBits[i][bit] << ",0,0\n";
+      }
+    }
+  }
+
+  if (stats->csvFile.empty()) {
+    edm::LogVerbatim("CSCDCCUnpacker|Stats") << csv.str();
+  } else {
+    std::ofstream out(stats->csvFile);
+    out << csv.str();
+  }
+}
+
 void CSCDCCUnpacker::fillDescriptions(edm::ConfigurationDescriptions& descriptions) {
   edm::ParameterSetDescription desc;
   desc.add<edm::InputTag>("InputObjects", edm::InputTag("rawDataCollector"))
@@ -218,7 +651,17 @@ void CSCDCCUnpacker::fillDescriptions(edm::ConfigurationDescriptions& descriptio
       ->setComment("# Use Examiner to unpack good chambers and skip only bad ones");
   desc.add<unsigned int>("ErrorMask", 0)->setComment("# This mask simply reduces error reporting");
   desc.add<bool>("UnpackStatusDigis", false)->setComment("# Unpack general status digis?");
+  desc.add<std::vector<std::string>>("StatusDigiProducts", {"CFEB", "DMB", "TMB", "ALCT", "DDU", "DCC"})
+      ->setComment("# Status digi collections to build when UnpackStatusDigis is set");
   desc.add<bool>("UseFormatStatus", true)->setComment("# Unpack FormatStatus digi?");
+  desc.add<std::vector<unsigned int>>("ROIFEDs", {})->setComment("# Region of interest: FED ids to unpack, empty = all");
+  desc.add<std::vector<unsigned int>>("ROICrates", {})
+      ->setComment("# Region of interest: readout crates (DMB header crate id) to unpack, empty = all");
+  desc.add<std::vector<unsigned int>>("ROIDMBs", {})
+      ->setComment("# Region of interest: DMB slots to unpack, empty = all");
+  desc.add<std::vector<unsigned int>>("ROICFEBs", {})
+      ->setComment("# Region of interest: CFEBs (0-6) to unpack strips and comparators from, empty = all");
+  desc.add<std::vector<unsigned int>>("ROILayers", {})->setComment("# Region of interest: layers (1-6), empty = all");
   desc.add<bool>("useRPCs", false)->setComment("Unpack RPC data");
   desc.add<bool>("useGEMs", true)->setComment("Unpack GEM trigger data");
   desc.add<bool>("useCSCShowers", true)->setComment("Unpack CSCShower trigger data");
@@ -234,6 +677,12 @@ void CSCDCCUnpacker::fillDescriptions(edm::ConfigurationDescriptions& descriptio
   desc.addUntracked<bool>("B904Setup", false)->setComment("# Make the unpacker aware of B904 test setup configuration");
   desc.addUntracked<int>("B904vmecrate", 1)->setComment("# Set vmecrate number for chamber used in B904 test setup");
   desc.addUntracked<int>("B904dmb", 3)->setComment("# Set dmb slot for chamber used in B904 test setup");
+  desc.addUntracked<bool>("ErrorSummaryMode", false)
+      ->setComment("# Count examiner errors per FED/DDU/chamber, keep only ErrorDetailLimit detailed records per error");
+  desc.addUntracked<unsigned int>("ErrorDetailLimit", 10)
+      ->setComment("# Detailed log lines and format status digis kept per examiner error bit in ErrorSummaryMode");
+  desc.addUntracked<std::string>("StatsCSVFile", "")
+      ->setComment("# CSV file for stage timing and FED statistics at end of job, empty prints to the log");
   descriptions.add("muonCSCDCCUnpacker", desc);
   descriptions.setComment(" This is the generic cfi file for CSC unpacking");
 }
@@ -250,8 +699,15 @@ void CSCDCCUnpacker::produce(edm::Event& e, const edm::EventSetup& c) {
   edm::ESHandle<CSCChamberMap> cscmap = c.getHandle(cscmapToken);
   const CSCChamberMap* cscmapping = cscmap.product();
 
+  // Which we now do: the lookup tables only go back to the maps when they change. Check both watchers, no ||.
+  const bool crateMapChanged = crateMapWatcher_.check(c);
+  const bool chamberMapChanged = chamberMapWatcher_.check(c);
+  if (crateMapChanged || chamberMapChanged)
+    chamberLookup_.reset();
+
   if (printEventNumber)
     ++numOfEvents;
+  ++stats_.events;
 
   /// Get a handle to the FED data collection
   edm::Handle<FEDRawDataCollection> rawdata;
@@ -290,11 +746,6 @@ void CSCDCCUnpacker::produce(edm::Event& e, const edm::EventSetup& c) {
   // then examinerMask for CSC level errors will be used during unpacking of each CSC block
   unsigned long dccBinCheckMask = 0x06080016;
 
-  // Post-LS1 FED/DDU ID mapping fix
-  const unsigned postLS1_map[] = {841, 842, 843, 844, 845, 846, 847, 848, 849, 831, 832, 833,
-                                  834, 835, 836, 837, 838, 839, 861, 862, 863, 864, 865, 866,
-                                  867, 868, 869, 851, 852, 853, 854, 855, 856, 857, 858, 859};
-
   // For new CSC readout layout, which wont include DCCs need to loop over DDU FED IDs. DCC IDs are included for backward compatibility with old data
   std::vector<unsigned int> cscFEDids;
 
@@ -313,8 +764,9 @@ void CSCDCCUnpacker::produce(edm::Event& e, const edm::EventSetup& c) {
     unsigned int id = cscFEDids[i];
     bool isDDU_FED = ((id >= FEDNumbering::MINCSCDDUFEDID) && (id <= FEDNumbering::MAXCSCDDUFEDID)) ? true : false;
 
-    /// uncomment this for regional unpacking
-    /// if (id!=SOME_ID) continue;
+    /// regional unpacking
+    if (!roi_.selectsFED(id))
+      continue;
 
     /// Take a reference to this FED's data
     const FEDRawData& fedData = rawdata->FEDData(id);
@@ -322,8 +774,14 @@ void CSCDCCUnpacker::produce(edm::Event& e, const edm::EventSetup& c) {
 
     if (length >= 32)  ///if fed has data then unpack it
     {
+      const unsigned int fedIndex = id - cscdccunpacker::kFirstFED;
+      stats_.fedBytes[fedIndex] += length;
+      ++stats_.fedCount[fedIndex];
+
       CSCDCCExaminer* examiner = nullptr;
       goodEvent = true;
+      /// false once every error bit of this FED has used up its detailed records (ErrorSummaryMode only)
+      bool keepErrorDetails = true;
       if (useExaminer)  ///examine event for integrity
       {
         // CSCDCCExaminer examiner;
@@ -355,7 +813,11 @@ void CSCDCCUnpacker::produce(edm::Event& e, const edm::EventSetup& c) {
                 }
                       */
 
-        int res = examiner->check(data, long(fedData.size() / 2));
+        int res;
+        {
+          cscdccunpacker::StageTimer timer(stats_, cscdccunpacker::kExaminerCheck);
+          res = examiner->check(data, long(fedData.size() / 2));
+        }
         if (res < 0) {
           goodEvent = false;
         } else {
@@ -370,9 +832,12 @@ void CSCDCCUnpacker::produce(edm::Event& e, const edm::EventSetup& c) {
               << std::hex << examiner->errors() << std::dec << std::endl;
          */
 
+        if (errorSummaryMode && (examiner->errors() != 0))
+          keepErrorDetails = countExaminerErrors(fedIndex, *examiner);
+
         // Fill Format status digis per FED
         // Remove examiner->errors() != 0 check if we need to put status digis for every event
-        if (useFormatStatus && (examiner->errors() != 0))
+        if (useFormatStatus && (examiner->errors() != 0) && keepErrorDetails)
           // formatStatusProduct->insertDigi(CSCDetId(1,1,1,1,1), CSCDCCFormatStatusDigi(id,examiner,dccBinCheckMask));
           formatStatusProduct->insertDigi(CSCDetId(1, 1, 1, 1, 1),
                                           CSCDCCFormatStatusDigi(id,
@@ -402,11 +867,22 @@ void CSCDCCUnpacker::produce(edm::Event& e, const edm::EventSetup& c) {
 
         std::vector<CSCDDUEventData> fed_Data;
         std::vector<CSCDDUEventData>* ptr_fedData = &fed_Data;
+        /// Region of interest decode of a DDU FED, replaces fed_Data when roiDecoded is set
+        cscdccunpacker::DDUBlock roiDDU;
+        bool roiDecoded = false;
 
         /// set default detid to that for E=+z, S=1, R=1, C=1, L=1
         CSCDetId layer(1, 1, 1, 1, 1);
 
-        if (isDDU_FED)  // Use new DDU FED readout mode
+        // Covers unpacking of the whole DDU/DCC block, including building CSCEventData for every chamber
+        const uint64_t decodeStart = cscdccunpacker::stageClock();
+
+        if (isDDU_FED && examiner && roi_.restrictsChambers())
+          roiDecoded = unpackRegionOfInterest(fedData, *examiner, roiDDU);
+
+        if (roiDecoded) {
+          // Unselected chambers were never decoded
+        } else if (isDDU_FED)  // Use new DDU FED readout mode
         {
           CSCDDUEventData single_dduData((short unsigned int*)fedData.data(), ptrExaminer);
           fed_Data.push_back(single_dduData);
@@ -427,7 +903,7 @@ void CSCDCCUnpacker::produce(edm::Event& e, const edm::EventSetup& c) {
           // ptr_fedData = &(dccData.dduData());
           fed_Data = dccData.dduData();
 
-          if (unpackStatusDigis) {
+          if (unpackDCCStatus) {
             /// DCC Trailer 2 added to dcc status product (to access TTS from DCC)
             short unsigned* bufForDcc = (short unsigned int*)fedData.data();
 
@@ -442,34 +918,46 @@ void CSCDCCUnpacker::produce(edm::Event& e, const edm::EventSetup& c) {
           }
         }
 
+        stats_.ticks[cscdccunpacker::kDDUDecode] += cscdccunpacker::stageClock() - decodeStart;
+        ++stats_.calls[cscdccunpacker::kDDUDecode];
+
         const std::vector<CSCDDUEventData>& dduData = *ptr_fedData;
 
-        for (unsigned int iDDU = 0; iDDU < dduData.size(); ++iDDU)  // loop over DDUs
+        const unsigned int nDDUs = roiDecoded ? 1 : dduData.size();
+
+        for (unsigned int iDDU = 0; iDDU < nDDUs; ++iDDU)  // loop over DDUs
         {
+          CSCDDUHeader dduHeader = roiDecoded ? roiDDU.header : dduData[iDDU].header();
+          CSCDDUTrailer dduTrailer = roiDecoded ? roiDDU.trailer : dduData[iDDU].trailer();
+
           /// skip the DDU if its data has serious errors
           /// define a mask for serious errors
-          if (dduData[iDDU].trailer().errorstat() & errorMask) {
+          if (dduTrailer.errorstat() & errorMask) {
             LogTrace("CSCDCCUnpacker|CSCRawToDigi")
                 << "FED ID" << id << " DDU# " << iDDU << " has serious error - no digis unpacked! " << std::hex
-                << dduData[iDDU].trailer().errorstat();
+                << dduTrailer.errorstat();
             continue;  // to next iteration of DDU loop
           }
 
-          if (unpackStatusDigis)
-            dduStatusProduct->insertDigi(
-                layer,
-                CSCDDUStatusDigi(dduData[iDDU].header().data(),
-                                 dduData[iDDU].trailer().data(),
-                                 /// DDU Trailer 0 added to ddu status product (to access TTS from DDU)
-                                 dduData[iDDU].trailer0()));
+          /// DDU Trailer 0 added to ddu status product (to access TTS from DDU)
+          if (unpackDDUStatus)
+            dduStatusProduct->insertDigi(layer,
+                                         CSCDDUStatusDigi(dduHeader.data(),
+                                                          dduTrailer.data(),
+                                                          roiDecoded ? roiDDU.trailer0 : dduData[iDDU].trailer0()));
 
           ///get a reference to chamber data
-          const std::vector<CSCEventData>& cscData = dduData[iDDU].cscData();
+          const std::vector<CSCEventData>& cscData = roiDecoded ? roiDDU.chambers : dduData[iDDU].cscData();
 
           // if (cscData.size() != 0) std::cout << "FED" << id << " DDU Source ID: " << dduData[iDDU].header().source_id() << " firmware version: " << dduData[iDDU].header().format_version() << std::endl;
 
           for (unsigned int iCSC = 0; iCSC < cscData.size(); ++iCSC)  // loop over CSCs
           {
+            /// Region of interest for fully decoded DDUs/DCCs, ROI decoded DDUs only hold selected chambers
+            if (!roiDecoded && roi_.restrictsChambers() &&
+                !roi_.selectsChamber(cscData[iCSC].dmbHeader()->crateID(), cscData[iCSC].dmbHeader()->dmbID()))
+              continue;
+
             ///first process chamber-wide digis such as LCT
 
             // int vmecrate = b904Setup ? b904vmecrate : cscData[iCSC].dmbHeader()->crateID();
@@ -484,7 +972,7 @@ void CSCDCCUnpacker::produce(edm::Event& e, const edm::EventSetup& c) {
               LogTrace("CSCDCCUnpacker|CSCRawToDigi") << "crate = " << vmecrate << "; dmb = " << dmb;
 
             if ((vmecrate >= 1) && (vmecrate <= 60) && (dmb >= 1) && (dmb <= 10) && (dmb != 6)) {
-              layer = pcrate->detId(vmecrate, dmb, icfeb, ilayer);
+              layer = chamberLookup_.detId(*pcrate, vmecrate, dmb, icfeb, ilayer);
             } else {
               LogTrace("CSCDCCUnpacker|CSCRawToDigi") << " detID input out of range!!! ";
               LogTrace("CSCDCCUnpacker|CSCRawToDigi") << " skipping chamber vme= " << vmecrate << " dmb= " << dmb;
@@ -494,11 +982,8 @@ void CSCDCCUnpacker::produce(edm::Event& e, const edm::EventSetup& c) {
             /// For Post-LS1 readout only. Check Chamber->FED/DDU mapping consistency.
             /// Skip chambers (special case of data corruption), which report wrong ID and pose as different chamber
             if (isDDU_FED) {
-              unsigned int dduid = cscmapping->ddu(layer);
-              if ((dduid >= 1) && (dduid <= 36)) {
-                dduid = postLS1_map[dduid - 1];  // Fix for Post-LS1 FED/DDU IDs mappings
-                // std::cout << "CSC " << layer << " -> " << id << ":" << dduid << ":" << vmecrate << ":" << dmb << std::endl;
-              }
+              // Post-LS1 FED/DDU IDs mapping fix is applied by the lookup
+              unsigned int dduid = chamberLookup_.expectedDDU(*pcrate, *cscmapping, vmecrate, dmb);
 
               /// Do not skip chamber data if mapping check is disabled or b904 setup data file is used
               if ((!disableMappingCheck) && (!b904Setup) && (id != dduid)) {
@@ -510,6 +995,10 @@ void CSCDCCUnpacker::produce(edm::Event& e, const edm::EventSetup& c) {
               }
             }
 
+            // Digi extraction for this chamber, digiInsert is also counted separately. Started after the ROI, range and
+            // mapping checks, so skipped chambers are not counted as decoded.
+            cscdccunpacker::StageTimer chamberTimer(stats_, cscdccunpacker::kChamberDecode);
+
             /// check alct data integrity
             int nalct = cscData[iCSC].dmbHeader()->nalct();
             bool goodALCT = false;
@@ -528,18 +1017,7 @@ void CSCDCCUnpacker::produce(edm::Event& e, const edm::EventSetup& c) {
             /// fill alct digi
             if (goodALCT) {
               std::vector<CSCALCTDigi> alctDigis = cscData[iCSC].alctHeader()->ALCTDigis();
-              if (SuppressZeroLCT) {
-                std::vector<CSCALCTDigi> alctDigis_0;
-                for (int unsigned i = 0; i < alctDigis.size(); ++i) {
-                  if (alctDigis[i].isValid()) {
-                    if (debug)
-                      LogTrace("CSCDCCUnpacker|CSCRawToDigi") << alctDigis[i] << std::endl;
-                    alctDigis_0.push_back(alctDigis[i]);
-                  }
-                }
-                alctProduct->move(std::make_pair(alctDigis_0.begin(), alctDigis_0.end()), layer);
-              } else
-                alctProduct->move(std::make_pair(alctDigis.begin(), alctDigis.end()), layer);
+              cscdccunpacker::emitLCTs(*alctProduct, alctDigis, layer, SuppressZeroLCT, debug);
 
               /// fill Run3 anode HMT Shower digis
               /// anode shower digis vector per ALCT BX from ALCT data
@@ -570,59 +1048,27 @@ void CSCDCCUnpacker::produce(edm::Event& e, const edm::EventSetup& c) {
             if (goodTMB) {
               std::vector<CSCCorrelatedLCTDigi> correlatedlctDigis =
                   cscData[iCSC].tmbHeader()->CorrelatedLCTDigis(layer.rawId());
-              if (SuppressZeroLCT) {
-                std::vector<CSCCorrelatedLCTDigi> correlatedlctDigis_0;
-                for (int unsigned i = 0; i < correlatedlctDigis.size(); ++i) {
-                  if (correlatedlctDigis[i].isValid()) {
-                    if (debug)
-                      LogTrace("CSCDCCUnpacker|CSCRawToDigi") << correlatedlctDigis[i] << std::endl;
-                    correlatedlctDigis_0.push_back(correlatedlctDigis[i]);
-                  }
-                }
-                corrlctProduct->move(std::make_pair(correlatedlctDigis_0.begin(), correlatedlctDigis_0.end()), layer);
-              } else
-                corrlctProduct->move(std::make_pair(correlatedlctDigis.begin(), correlatedlctDigis.end()), layer);
+              cscdccunpacker::emitLCTs(*corrlctProduct, correlatedlctDigis, layer, SuppressZeroLCT, debug);
 
               std::vector<CSCCLCTDigi> clctDigis = cscData[iCSC].tmbHeader()->CLCTDigis(layer.rawId());
-              if (SuppressZeroLCT) {
-                std::vector<CSCCLCTDigi> clctDigis_0;
-                for (int unsigned i = 0; i < clctDigis.size(); ++i) {
-                  if (clctDigis[i].isValid()) {
-                    if (debug)
-                      LogTrace("CSCDCCUnpacker|CSCRawToDigi") << clctDigis[i] << std::endl;
-                    clctDigis_0.push_back(clctDigis[i]);
-                  }
-                }
-                clctProduct->move(std::make_pair(clctDigis_0.begin(), clctDigis_0.end()), layer);
-              } else
-                clctProduct->move(std::make_pair(clctDigis.begin(), clctDigis.end()), layer);
+              cscdccunpacker::emitLCTs(*clctProduct, clctDigis, layer, SuppressZeroLCT, debug);
 
               /// fill Run3 HMT Shower digis
               if (useCSCShowers_) {
                 /// (O)TMB Shower digi sent to MPC LCT trigger data
                 CSCShowerDigi lctShowerDigi = cscData[iCSC].tmbHeader()->showerDigi(layer.rawId());
-                if (lctShowerDigi.isValid()) {
-                  std::vector<CSCShowerDigi> lctShowerDigis;
-                  lctShowerDigis.push_back(lctShowerDigi);
-                  lctShowerProduct->move(std::make_pair(lctShowerDigis.begin(), lctShowerDigis.end()), layer);
-                }
+                if (lctShowerDigi.isValid())
+                  lctShowerProduct->insertDigi(layer, lctShowerDigi);
 
                 /// anode shower digis from OTMB header data
                 CSCShowerDigi anodeShowerDigiOTMB = cscData[iCSC].tmbHeader()->anodeShowerDigi(layer.rawId());
-                if (anodeShowerDigiOTMB.isValid()) {
-                  std::vector<CSCShowerDigi> anodeShowerDigis;
-                  anodeShowerDigis.push_back(anodeShowerDigiOTMB);
-                  anodeShowerProductOTMB->move(std::make_pair(anodeShowerDigis.begin(), anodeShowerDigis.end()), layer);
-                }
+                if (anodeShowerDigiOTMB.isValid())
+                  anodeShowerProductOTMB->insertDigi(layer, anodeShowerDigiOTMB);
 
                 /// cathode shower digis from OTMB header data
                 CSCShowerDigi cathodeShowerDigiOTMB = cscData[iCSC].tmbHeader()->cathodeShowerDigi(layer.rawId());
-                if (cathodeShowerDigiOTMB.isValid()) {
-                  std::vector<CSCShowerDigi> cathodeShowerDigis;
-                  cathodeShowerDigis.push_back(cathodeShowerDigiOTMB);
-                  cathodeShowerProductOTMB->move(std::make_pair(cathodeShowerDigis.begin(), cathodeShowerDigis.end()),
-                                                 layer);
-                }
+                if (cathodeShowerDigiOTMB.isValid())
+                  cathodeShowerProductOTMB->insertDigi(layer, cathodeShowerDigiOTMB);
               }
 
               /// fill CSC-RPC or CSC-GEMs digis
@@ -657,41 +1103,49 @@ void CSCDCCUnpacker::produce(edm::Event& e, const edm::EventSetup& c) {
             }
 
             /// fill cfeb status digi
-            if (unpackStatusDigis) {
+            if (unpackCFEBStatus) {
               for (icfeb = 0; icfeb < CSCConstants::MAX_CFEBS_RUN2; ++icfeb)  ///loop over status digis
               {
-                if (cscData[iCSC].cfebData(icfeb) != nullptr)
+                if (roi_.selectsCFEB(icfeb) && cscData[iCSC].cfebData(icfeb) != nullptr)
                   cfebStatusProduct->insertDigi(layer, cscData[iCSC].cfebData(icfeb)->statusDigi());
               }
-              /// fill dmb status digi
+            }
+            /// fill dmb status digi
+            if (unpackDMBStatus)
               dmbStatusProduct->insertDigi(
                   layer, CSCDMBStatusDigi(cscData[iCSC].dmbHeader()->data(), cscData[iCSC].dmbTrailer()->data()));
-              if (goodTMB)
-                tmbStatusProduct->insertDigi(
-                    layer,
-                    CSCTMBStatusDigi(cscData[iCSC].tmbHeader()->data(), cscData[iCSC].tmbData()->tmbTrailer()->data()));
-              if (goodALCT)
-                alctStatusProduct->insertDigi(
-                    layer, CSCALCTStatusDigi(cscData[iCSC].alctHeader()->data(), cscData[iCSC].alctTrailer()->data()));
-            }
+            if (unpackTMBStatus && goodTMB)
+              tmbStatusProduct->insertDigi(
+                  layer,
+                  CSCTMBStatusDigi(cscData[iCSC].tmbHeader()->data(), cscData[iCSC].tmbData()->tmbTrailer()->data()));
+            if (unpackALCTStatus && goodALCT)
+              alctStatusProduct->insertDigi(
+                  layer, CSCALCTStatusDigi(cscData[iCSC].alctHeader()->data(), cscData[iCSC].alctTrailer()->data()));
 
             /// fill wire, strip and comparator digis...
             for (int ilayer = CSCDetId::minLayerId(); ilayer <= CSCDetId::maxLayerId(); ++ilayer) {
+              if (!roi_.selectsLayer(ilayer))
+                continue;
+
               /// set layer, dmb and vme are valid because already checked in line 240
               // (You have to be kidding. Line 240 in whose universe?)
 
               // Allocate all ME1/1 wire digis to ring 1
-              layer = pcrate->detId(vmecrate, dmb, 0, ilayer);
+              layer = chamberLookup_.detId(*pcrate, vmecrate, dmb, 0, ilayer);
               {
                 std::vector<CSCWireDigi> wireDigis = cscData[iCSC].wireDigis(ilayer);
+                cscdccunpacker::StageTimer timer(stats_, cscdccunpacker::kDigiInsert);
                 wireProduct->move(std::make_pair(wireDigis.begin(), wireDigis.end()), layer);
               }
 
               for (icfeb = 0; icfeb < CSCConstants::MAX_CFEBS_RUN2; ++icfeb) {
-                layer = pcrate->detId(vmecrate, dmb, icfeb, ilayer);
+                if (!roi_.selectsCFEB(icfeb))
+                  continue;
+                layer = chamberLookup_.detId(*pcrate, vmecrate, dmb, icfeb, ilayer);
                 if (cscData[iCSC].cfebData(icfeb) && cscData[iCSC].cfebData(icfeb)->check()) {
                   std::vector<CSCStripDigi> stripDigis;
                   cscData[iCSC].cfebData(icfeb)->digis(layer.rawId(), stripDigis);
+                  cscdccunpacker::StageTimer timer(stats_, cscdccunpacker::kDigiInsert);
                   stripProduct->move(std::make_pair(stripDigis.begin(), stripDigis.end()), layer);
                 }
               }
@@ -699,12 +1153,15 @@ void CSCDCCUnpacker::produce(edm::Event& e, const edm::EventSetup& c) {
               if (goodTMB && (cscData[iCSC].tmbHeader() != nullptr)) {
                 int nCFEBs = cscData[iCSC].tmbHeader()->NCFEBs();
                 for (icfeb = 0; icfeb < nCFEBs; ++icfeb) {
-                  layer = pcrate->detId(vmecrate, dmb, icfeb, ilayer);
+                  if (!roi_.selectsCFEB(icfeb))
+                    continue;
+                  layer = chamberLookup_.detId(*pcrate, vmecrate, dmb, icfeb, ilayer);
                   std::vector<CSCComparatorDigi> comparatorDigis =
                       cscData[iCSC].comparatorData()->comparatorDigis(layer.rawId(), icfeb);
                   // Set cfeb=0, so that ME1/a and ME1/b comparators go to
                   // ring 1.
-                  layer = pcrate->detId(vmecrate, dmb, 0, ilayer);
+                  layer = chamberLookup_.detId(*pcrate, vmecrate, dmb, 0, ilayer);
+                  cscdccunpacker::StageTimer timer(stats_, cscdccunpacker::kDigiInsert);
                   comparatorProduct->move(std::make_pair(comparatorDigis.begin(), comparatorDigis.end()), layer);
                 }
               }  // end of loop over cfebs
@@ -714,8 +1171,14 @@ void CSCDCCUnpacker::produce(edm::Event& e, const edm::EventSetup& c) {
       }          // end of good event
       else {
         LogTrace("CSCDCCUnpacker|CSCRawToDigi") << "ERROR! Examiner rejected FED #" << id;
+        ++stats_.fedRejected[fedIndex];
         if (examiner) {
-          for (int i = 0; i < examiner->nERRORS; ++i) {
+          const uint32_t errors = examiner->errors();
+          for (unsigned int i = 0; i < cscdccunpacker::kNumErrorBits; ++i) {
+            if ((errors >> i) & 0x1)
+              ++stats_.rejectedBits[i];
+          }
+          for (int i = 0; keepErrorDetails && i < examiner->nERRORS; ++i) {
             if (((examinerMask & examiner->errors()) >> i) & 0x1)
               LogTrace("CSCDCCUnpacker|CSCRawToDigi") << examiner->errName(i);
           }
@@ -744,14 +1207,18 @@ void CSCDCCUnpacker::produce(edm::Event& e, const edm::EventSetup& c) {
   if (useFormatStatus)
     e.put(std::move(formatStatusProduct), "MuonCSCDCCFormatStatusDigi");
 
-  if (unpackStatusDigis) {
+  if (unpackCFEBStatus)
     e.put(std::move(cfebStatusProduct), "MuonCSCCFEBStatusDigi");
+  if (unpackDMBStatus)
     e.put(std::move(dmbStatusProduct), "MuonCSCDMBStatusDigi");
+  if (unpackTMBStatus)
     e.put(std::move(tmbStatusProduct), "MuonCSCTMBStatusDigi");
+  if (unpackDDUStatus)
     e.put(std::move(dduStatusProduct), "MuonCSCDDUStatusDigi");
+  if (unpackDCCStatus)
     e.put(std::move(dccStatusProduct), "MuonCSCDCCStatusDigi");
+  if (unpackALCTStatus)
     e.put(std::move(alctStatusProduct), "MuonCSCALCTStatusDigi");
-  }
 
   if (useRPCs_) {
     e.put(std::move(rpcProduct), "MuonCSCRPCDigi");
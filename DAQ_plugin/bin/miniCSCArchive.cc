@@ -0,0 +1,149 @@
+// -*- C++ -*-
+//
+// Package:    MiniCSC/MiniCSC
+// Program:    miniCSCArchive
+//
+// Description: Repacks the DDU events of RUI raw files into block compressed archives (.mcsa) and back. The events
+//              come back byte for byte, anything the DDU framer rejects (words outside a frame, truncated or
+//              oversized events, counted as dropped by pack) is not archived.
+//
+//   miniCSCArchive pack [-c zstd|lz4] [-l level] [-b blockMB] [-j threads] -o out.mcsa in1.raw [in2.raw ...]
+//   miniCSCArchive unpack [-j threads] -o out.raw in1.mcsa [in2.mcsa ...]
+//   miniCSCArchive info in1.mcsa [in2.mcsa ...]
+//
+// Archives can be given to MiniCSCPrefetchRawReader in place of the raw files (RUInn = ['run.mcsa']).
+//
+// Original Author:  Dylan Parks
+//
+//
+
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "MiniCSC/MiniCSC/interface/MiniCSCArchive.h"
+#include "MiniCSC/MiniCSC/interface/RUIPrefetcher.h"
+
+namespace {
+  void usage() {
+    std::cerr << "Usage:\n"
+              << "  miniCSCArchive pack [-c zstd|lz4] [-l level] [-b blockMB] [-j threads] -o out.mcsa in.raw...\n"
+              << "  miniCSCArchive unpack [-j threads] -o out.raw in.mcsa...\n"
+              << "  miniCSCArchive info in.mcsa...\n";
+    exit(1);
+  }
+
+  struct Options {
+    std::string mode, output;
+    std::vector<std::string> inputs;
+    minicscarchive::Compression compression = minicscarchive::kZstd;
+    int level = 3;
+    size_t blockBytes = 4 << 20;
+    unsigned int threads = std::thread::hardware_concurrency();
+  };
+
+  Options parse(int argc, char **argv) {
+    if (argc < 3) {
+      usage();
+    }
+    Options options;
+    options.mode = argv[1];
+    for (int i = 2; i < argc; i++) {
+      const std::string arg = argv[i];
+      const bool hasValue = i + 1 < argc;
+      if (arg == "-o" && hasValue) {
+        options.output = argv[++i];
+      } else if (arg == "-c" && hasValue) {
+        const std::string name = argv[++i];
+        if (name == "zstd") {
+          options.compression = minicscarchive::kZstd;
+        } else if (name == "lz4") {
+          options.compression = minicscarchive::kLZ4;
+        } else {
+          usage();
+        }
+      } else if (arg == "-l" && hasValue) {
+        options.level = atoi(argv[++i]);
+      } else if (arg == "-b" && hasValue) {
+        options.blockBytes = static_cast<size_t>(atoi(argv[++i])) << 20;
+      } else if (arg == "-j" && hasValue) {
+        options.threads = atoi(argv[++i]);
+      } else if (arg[0] == '-') {
+        usage();
+      } else {
+        options.inputs.push_back(arg);
+      }
+    }
+    if (options.inputs.empty() || (options.mode != "info" && options.output.empty())) {
+      usage();
+    }
+    return options;
+  }
+
+  void pack(const Options &options) {
+    // The prefetcher does the DDU framing, same as when reading the raw files in cmsRun
+    RUIPrefetcher raw(options.inputs, 16 << 20, 4 << 20, 4, false);
+    minicscarchive::Writer archive(
+        options.output, options.compression, options.level, options.blockBytes, options.threads);
+    const uint16_t *event;
+    size_t words;
+    while (raw.next(event, words)) {
+      archive.add(event, words);
+    }
+    archive.close();
+
+    std::cout << "Events: " << archive.numEvents() << std::endl;
+    std::cout << "Dropped (truncated/oversized): " << raw.droppedEvents() << std::endl;
+    std::cout << "Raw MB: " << archive.rawBytes() / 1e6 << ", compressed MB: " << archive.compressedBytes() / 1e6
+              << ", ratio: " << (archive.compressedBytes() ? 1. * archive.rawBytes() / archive.compressedBytes() : 0.)
+              << std::endl;
+  }
+
+  void unpack(const Options &options) {
+    minicscarchive::Reader archive(options.inputs, options.threads);
+    std::ofstream out(options.output, std::ios::binary | std::ios::trunc);
+    const uint16_t *event;
+    size_t words;
+    uint64_t events = 0;
+    while (archive.next(event, words)) {
+      out.write(reinterpret_cast<const char *>(event), words * 2);
+      events++;
+    }
+    if (!out) {
+      throw std::runtime_error("write to " + options.output + " failed");
+    }
+    std::cout << "Events: " << events << std::endl;
+  }
+
+  void info(const Options &options) {
+    for (const std::string &input : options.inputs) {
+      minicscarchive::Reader archive({input}, 1);
+      std::cout << input << ": " << archive.numEvents() << " events in " << archive.numBlocks() << " blocks"
+                << std::endl;
+    }
+  }
+}  // namespace
+
+int main(int argc, char **argv) {
+  const Options options = parse(argc, argv);
+  try {
+    if (options.mode == "pack") {
+      pack(options);
+    } else if (options.mode == "unpack") {
+      unpack(options);
+    } else if (options.mode == "info") {
+      info(options);
+    } else {
+      usage();
+    }
+  } catch (std::exception &e) {
+    std::cerr << "miniCSCArchive: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
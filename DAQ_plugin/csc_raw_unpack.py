@@ -2,6 +2,8 @@
 import FWCore.ParameterSet.Config as cms
 from FWCore.ParameterSet.VarParsing import VarParsing
 options = VarParsing ('analysis')
+options.register ("prefetch", True, VarParsing.multiplicity.singleton, VarParsing.varType.bool,
+                  "Read the RUI files ahead on background threads (MiniCSCPrefetchRawReader) instead of CSCFileReader")
 options.parseArguments()
 process = cms.Process("reader")
 
@@ -40,6 +42,21 @@ process.rawDataCollector = cms.EDProducer('CSCFileReader',
 	RUI01  = cms.untracked.vstring(options.inputFiles)
 )
 
+# Same FED/RUI layout, but each RUI is read in large blocks on its own thread so the event loop does not wait on
+# disk (EOS/FUSE mounts especially). Keeps numBuffers x blockSizeMB of memory per RUI.
+# inputFiles can also be .mcsa archives made with miniCSCArchive, decompressed on decompressionThreads threads.
+# Like CSCFileReader it ends the job (with an "EOF" exception) once every RUI is out of events, so maxEvents=-1 reads
+# the files to the end.
+if options.prefetch:
+    process.rawDataCollector = cms.EDProducer('MiniCSCPrefetchRawReader',
+        **process.rawDataCollector.parameters_(),
+        blockSizeMB = cms.untracked.uint32(16),
+        maxEventSizeMB = cms.untracked.uint32(4),
+        numBuffers = cms.untracked.uint32(4),
+        directIO = cms.untracked.bool(False),
+        decompressionThreads = cms.untracked.uint32(4)
+    )
+
 process.FEVT = cms.OutputModule("PoolOutputModule",
         #fileName = cms.untracked.string("test_21_500.root"),
 		fileName = cms.untracked.string(options.outputFile),
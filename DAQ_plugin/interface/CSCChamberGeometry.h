@@ -0,0 +1,74 @@
+#ifndef MiniCSC_MiniCSC_CSCChamberGeometry_h
+#define MiniCSC_MiniCSC_CSCChamberGeometry_h
+// -*- C++ -*-
+//
+// Package:    MiniCSC/MiniCSC
+// Class:      CSCChamberGeometry
+//
+/**\class CSCChamberGeometry CSCChamberGeometry.h MiniCSC/MiniCSC/interface/CSCChamberGeometry.h
+
+ Description: Compile time readout geometry of the chambers MiniCSC can analyze
+
+ Implementation:
+     Each chamber type is a traits struct of constexpr sizes. MiniCSC instantiates its per-event code on the struct,
+     so channel ranges and offsets are constants there, and dispatchGeometry picks the instantiation from the
+     chamberType parameter once per job.
+     Both chambers are read out as ME1/1: ring 4 (ME1/1a) digis continue the ring 1 (ME1/1b) strip numbering.
+*/
+//
+// Original Author:  Dylan Parks
+//
+//
+
+#include <cstdint>
+#include <string>
+
+#include "FWCore/Utilities/interface/Exception.h"
+
+namespace cscgeometry {
+
+  /// ME1/1a strips come after the 64 strips of ME1/1b
+  constexpr int me11StripOffset(int ring) { return ring == 4 ? 64 : 0; }
+
+  /// The test stand miniCSC. Strip and wiregroup ranges are the ones the plots always used.
+  struct MiniCSC {
+    static constexpr const char *kName = "miniCSC";
+    static constexpr uint16_t kNumLayers = 6;
+    static constexpr uint16_t kNumStrips = 120;
+    static constexpr uint16_t kNumHalfStrips = 225;
+    static constexpr uint16_t kNumWiregroups = 120;
+    static constexpr uint16_t kNumCFEBs = 7;
+    static constexpr uint16_t kStripsPerCFEB = 16;
+    static constexpr int stripOffset(int ring) { return me11StripOffset(ring); }
+    static constexpr int halfStripOffset(int ring) { return 2 * me11StripOffset(ring); }
+  };
+
+  /// Full size ME1/1 chamber, 64 ME1/1b + 48 ME1/1a strips on 7 DCFEBs and 48 wiregroups
+  struct ME11 {
+    static constexpr const char *kName = "ME11";
+    static constexpr uint16_t kNumLayers = 6;
+    static constexpr uint16_t kNumStrips = 112;
+    static constexpr uint16_t kNumHalfStrips = 224;
+    static constexpr uint16_t kNumWiregroups = 48;
+    static constexpr uint16_t kNumCFEBs = 7;
+    static constexpr uint16_t kStripsPerCFEB = 16;
+    static constexpr int stripOffset(int ring) { return me11StripOffset(ring); }
+    static constexpr int halfStripOffset(int ring) { return 2 * me11StripOffset(ring); }
+  };
+
+  /// Calls f with a default constructed traits struct of the named chamber
+  template <class F>
+  void dispatchGeometry(const std::string &name, F &&f) {
+    if (name == MiniCSC::kName) {
+      f(MiniCSC());
+    } else if (name == ME11::kName) {
+      f(ME11());
+    } else {
+      throw cms::Exception("Configuration") << "Unknown chamberType " << name << ", use " << MiniCSC::kName << " or "
+                                            << ME11::kName;
+    }
+  }
+
+}  // namespace cscgeometry
+
+#endif
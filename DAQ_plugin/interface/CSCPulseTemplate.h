@@ -0,0 +1,69 @@
+#ifndef MiniCSC_MiniCSC_CSCPulseTemplate_h
+#define MiniCSC_MiniCSC_CSCPulseTemplate_h
+// -*- C++ -*-
+//
+// Package:    MiniCSC/MiniCSC
+// Class:      CSCPulseTemplate
+//
+/**\class CSCPulseTemplate CSCPulseTemplate.h MiniCSC/MiniCSC/interface/CSCPulseTemplate.h
+
+ Description: Fits amplitude and peak time of a cathode strip pulse to the CFEB shaper template
+
+ Implementation:
+     The template is a semi-gaussian (t/tp)^4 exp(4 (1 - t/tp)), sampled every 50 ns in 8 time bins.
+     For a fixed peak time the best amplitude is linear: A = (s.f) / (f.f), and the remaining chi2 is
+     s.s - (s.f)^2 / (f.f). The sampled template is tabulated once for every peak time on a fine grid (normalized so
+     f.f = 1), so a fit is a search for the largest dot product s.f over the table: a coarse pass around the
+     highest sample, a fine pass around the best coarse point, then a parabola through the three best points for
+     the sub-step time. No minimizer, no allocation, a few hundred multiply-adds per strip.
+*/
+//
+// Original Author:  Dylan Parks
+//
+//
+
+#include <vector>
+
+class CSCPulseTemplate {
+public:
+  static constexpr int kNumTimeBins = 8;
+  /// Time between cathode samples, ns
+  static constexpr float kBinWidth = 50.f;
+
+  struct Result {
+    /// Pulse height above pedestal, ADC
+    float amplitude = 0.f;
+    /// Time of the pulse peak from the start of time bin 0, ns
+    float peakTime = 0.f;
+    /// Fraction of the signal (s.s) the template explains, 1 is a perfect fit
+    float quality = 0.f;
+    /// Sum of the fitted pulse over the 8 time bins, same units as a plain sum of the samples without the noise
+    float charge = 0.f;
+  };
+
+  /// @param peakingTime shaper peaking time (start of pulse to peak), ns
+  /// @param step peak time grid spacing of the table, ns
+  explicit CSCPulseTemplate(float peakingTime = 100.f, float step = 1.f);
+
+  /// @param samples kNumTimeBins pedestal subtracted ADC values
+  Result fit(const float *samples) const;
+
+  /// Template value at time t (ns) for a pulse peaking at 0, peak value 1
+  float shape(float t) const;
+
+private:
+  /// Dot product of the samples with table entry point
+  float dot(const float *samples, int point) const;
+
+  const float peakingTime_;
+  const float step_;
+  int numPoints_;
+  /// numPoints_ x kNumTimeBins samples of the template, each row normalized to unit length
+  std::vector<float> table_;
+  /// Length of each row before normalization
+  std::vector<float> norm_;
+  /// Sum of each row before normalization
+  std::vector<float> sum_;
+};
+
+#endif
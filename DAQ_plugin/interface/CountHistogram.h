@@ -0,0 +1,122 @@
+#ifndef MiniCSC_MiniCSC_CountHistogram_h
+#define MiniCSC_MiniCSC_CountHistogram_h
+// -*- C++ -*-
+//
+// Package:    MiniCSC/MiniCSC
+// Class:      CountHistogram
+//
+/**\class CountHistogram CountHistogram.h MiniCSC/MiniCSC/interface/CountHistogram.h
+
+ Description: Fixed binning 1D/2D histogram with 32-bit integer bins, turned into the usual ROOT type for writing
+
+ Implementation:
+     Occupancy and charge spectra only count, so a double (TH1D) or float (TH2F) per bin is twice the memory and cache
+     footprint the event loop needs. Bins are uint32 counters laid out like ROOT's global bins (under/overflow
+     included, bin = binx + (nx + 2) * biny), and the sums ROOT keeps for its statistics are kept alongside, so the
+     histogram made by toROOT() has the same contents, entries, mean and RMS as if it had been filled directly.
+     The first weighted Fill switches the histogram to double bins with a sum of squared weights, histograms that are
+     only counted never pay for them.
+     Fill/GetEntries/GetName follow TH1 so the filling code reads the same as with a ROOT histogram.
+*/
+//
+// Original Author:  Dylan Parks
+//
+//
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "TDirectory.h"
+#include "TH1.h"
+#include "TH2.h"
+
+class CountHistogramBase {
+public:
+  virtual ~CountHistogramBase() = default;
+
+  void Fill(double x) { fill(xBin(x), x, 0., 1.); }
+  /// y for a 2D histogram, weight for a 1D one, as with TH2::Fill and TH1::Fill
+  void Fill(double x, double v) {
+    if (ny_ > 0) {
+      fill(xBin(x) + (nx_ + 2) * yBin(v), x, v, 1.);
+    } else {
+      fill(xBin(x), x, 0., v);
+    }
+  }
+  void Fill(double x, double y, double w) { fill(xBin(x) + (nx_ + 2) * yBin(y), x, y, w); }
+
+  double GetEntries() const { return entries_; }
+  const char *GetName() const { return name_.c_str(); }
+  bool isWeighted() const { return !weights_.empty(); }
+
+  /// New ROOT histogram with the same name, title, binning and contents, not attached to any directory
+  virtual std::unique_ptr<TH1> toROOT() const = 0;
+  /// Adds the contents of a ROOT histogram with the same binning (e.g. read back from a checkpoint)
+  void add(const TH1 &hist);
+
+protected:
+  CountHistogramBase(const char *name, const char *title, int nx, double xlow, double xup);
+  CountHistogramBase(
+      const char *name, const char *title, int nx, double xlow, double xup, int ny, double ylow, double yup);
+
+  /// Copies the bins and statistics into hist, which has the binning of this histogram
+  void fillROOT(TH1 &hist) const;
+
+  const std::string name_, title_;
+  const int nx_, ny_;
+  const double xlow_, xup_, ylow_, yup_;
+
+private:
+  int xBin(double x) const { return axisBin(x, nx_, xlow_, xup_); }
+  int yBin(double y) const { return ny_ > 0 ? axisBin(y, ny_, ylow_, yup_) : 0; }
+  /// Same as TAxis::FindBin for fixed bins
+  static int axisBin(double v, int n, double low, double up) {
+    if (v < low) {
+      return 0;
+    }
+    if (!(v < up)) {
+      return n + 1;
+    }
+    return 1 + static_cast<int>(n * (v - low) / (up - low));
+  }
+  bool inRange(int bin) const;
+  void fill(int bin, double x, double y, double w);
+  void makeWeighted();
+
+  std::vector<uint32_t> counts_;
+  /// Only allocated after a weighted Fill, counts_ is released then
+  std::vector<double> weights_, sumw2_;
+  double entries_ = 0;
+  /// fTsumw, fTsumw2, fTsumwx, fTsumwx2, fTsumwy, fTsumwy2, fTsumwxy of TH1/TH2, in range fills only
+  double stats_[7] = {};
+};
+
+/// Fills like the other ROOT types, H (TH1D, TH1I, TH2F, ...) is only built for writing
+template <class H>
+class CountHistogram : public CountHistogramBase {
+public:
+  CountHistogram(const char *name, const char *title, int nx, double xlow, double xup)
+      : CountHistogramBase(name, title, nx, xlow, xup) {}
+  CountHistogram(const char *name, const char *title, int nx, double xlow, double xup, int ny, double ylow, double yup)
+      : CountHistogramBase(name, title, nx, xlow, xup, ny, ylow, yup) {}
+
+  std::unique_ptr<TH1> toROOT() const override {
+    std::unique_ptr<TH1> hist;
+    {
+      // Not owned by whatever directory is current
+      TDirectory::TContext context(nullptr);
+      if constexpr (std::is_base_of<TH2, H>::value) {
+        hist = std::make_unique<H>(name_.c_str(), title_.c_str(), nx_, xlow_, xup_, ny_, ylow_, yup_);
+      } else {
+        hist = std::make_unique<H>(name_.c_str(), title_.c_str(), nx_, xlow_, xup_);
+      }
+    }
+    fillROOT(*hist);
+    return hist;
+  }
+};
+
+#endif
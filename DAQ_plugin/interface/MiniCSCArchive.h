@@ -0,0 +1,168 @@
+#ifndef MiniCSC_MiniCSC_MiniCSCArchive_h
+#define MiniCSC_MiniCSC_MiniCSCArchive_h
+// -*- C++ -*-
+//
+// Package:    MiniCSC/MiniCSC
+// Class:      MiniCSCArchive
+//
+/**\class MiniCSCArchive MiniCSCArchive.h MiniCSC/MiniCSC/interface/MiniCSCArchive.h
+
+ Description: Block compressed, indexed archive of RUI DDU events (.mcsa) and its writer/reader
+
+ Implementation:
+     File layout (all integers little endian):
+       FileHeader
+       per block: BlockHeader, numEvents x uint32 event length in 64-bit words, compressed event data
+       BlockEntry for every block (the directory)
+       FileTrailer
+     Blocks are compressed independently (zstd or LZ4) and carry a zlib crc32 of their uncompressed data, so a
+     reader can decompress several at once and jump to any event through the directory without touching the rest.
+     Only the DDU framed events RUIPrefetcher finds are stored, and those come back byte for byte on unpacking. Words
+     outside a DDU frame and the events the framer drops (truncated or oversized) are not in the archive.
+     The reader only decodes blocks once next() or skip() is called, so opening one just to read its index is cheap.
+*/
+//
+// Original Author:  Dylan Parks
+//
+//
+
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <future>
+#include <string>
+#include <vector>
+
+#include "MiniCSC/MiniCSC/interface/RUIEventSource.h"
+
+namespace minicscarchive {
+
+  constexpr uint32_t kFileMagic = 0x4153434D;   // "MCSA"
+  constexpr uint32_t kIndexMagic = 0x4953434D;  // "MCSI"
+  constexpr uint32_t kVersion = 1;
+  /// File name extension the raw readers use to pick the archive reader
+  constexpr const char *kExtension = ".mcsa";
+
+  enum Compression : uint32_t { kZstd = 1, kLZ4 = 2 };
+
+  struct FileHeader {
+    uint32_t magic, version, compression, reserved;
+  };
+
+  struct BlockHeader {
+    uint32_t compressedBytes, rawBytes, numEvents, crc32;
+    uint64_t firstEvent;
+  };
+
+  struct BlockEntry {
+    /// File offset of the BlockHeader
+    uint64_t offset;
+    uint64_t firstEvent;
+    uint32_t numEvents, reserved;
+  };
+
+  struct FileTrailer {
+    uint64_t directoryOffset, numEvents;
+    uint32_t numBlocks, magic;
+  };
+
+  static_assert(sizeof(FileHeader) == 16 && sizeof(BlockHeader) == 24 && sizeof(BlockEntry) == 24 &&
+                    sizeof(FileTrailer) == 24,
+                "archive structs must not be padded");
+
+  /// True if the file name says archive
+  bool isArchive(const std::string &path);
+
+  /// Packs events into an archive. Blocks are compressed on up to numThreads threads and written in order.
+  class Writer {
+  public:
+    Writer(const std::string &path, Compression compression, int level, size_t blockBytes, unsigned int numThreads);
+    ~Writer();
+
+    /// Event length must be a whole number of 64-bit words, as in the RUI files
+    void add(const uint16_t *event, size_t words);
+    /// Writes the last block, the directory and the trailer
+    void close();
+
+    uint64_t numEvents() const { return numEvents_; }
+    uint64_t rawBytes() const { return rawBytes_; }
+    uint64_t compressedBytes() const { return compressedBytes_; }
+
+  private:
+    struct Block {
+      BlockHeader header;
+      std::vector<uint32_t> lengths;
+      std::vector<char> data;
+    };
+
+    static Block compress(Compression compression,
+                          int level,
+                          uint64_t firstEvent,
+                          std::vector<uint64_t> events,
+                          std::vector<uint32_t> lengths);
+    void flush();
+    void write(Block block);
+
+    std::ofstream out_;
+    const Compression compression_;
+    const int level_;
+    const size_t blockWords_;
+    const unsigned int numThreads_;
+
+    std::vector<uint64_t> pending_;
+    std::vector<uint32_t> pendingLengths_;
+    std::deque<std::future<Block>> inflight_;
+    std::vector<BlockEntry> directory_;
+
+    uint64_t numEvents_ = 0, blockFirstEvent_ = 0, rawBytes_ = 0, compressedBytes_ = 0;
+    bool closed_ = false;
+  };
+
+  /// Reads one or more archives as a single event stream, decompressing up to numThreads blocks ahead
+  class Reader : public RUIEventSource {
+  public:
+    /// Reads the index of every file, no block is decoded yet
+    Reader(const std::vector<std::string> &files, unsigned int numThreads);
+    ~Reader() override;
+
+    bool next(const uint16_t *&event, size_t &words) override;
+    /// Jumps straight to the block holding the target event
+    void skip(uint64_t numEvents) override;
+    uint64_t droppedEvents() const override { return 0; }
+    uint64_t stalls() const override { return stalls_; }
+
+    uint64_t numEvents() const { return totalEvents_; }
+    size_t numBlocks() const { return blocks_.size(); }
+
+  private:
+    struct Archive {
+      int fd;
+      Compression compression;
+      std::string path;
+    };
+    struct Decoded {
+      std::vector<uint64_t> data;
+      std::vector<uint32_t> lengths;
+    };
+
+    Decoded decode(size_t block) const;
+    void schedule();
+
+    const unsigned int numThreads_;
+    std::vector<Archive> archives_;
+    /// Every block of every archive, in reading order: (archive, directory entry)
+    std::vector<std::pair<size_t, BlockEntry>> blocks_;
+    /// Event number of the first event of each block, counted over all archives
+    std::vector<uint64_t> blockFirst_;
+    uint64_t totalEvents_ = 0;
+
+    size_t nextBlock_ = 0;
+    std::deque<std::future<Decoded>> window_;
+    Decoded current_;
+    size_t eventIndex_ = 0, offset_ = 0;
+    uint64_t stalls_ = 0;
+  };
+
+}  // namespace minicscarchive
+
+#endif
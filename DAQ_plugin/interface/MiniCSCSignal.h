@@ -0,0 +1,108 @@
+#ifndef MiniCSC_MiniCSC_MiniCSCSignal_h
+#define MiniCSC_MiniCSC_MiniCSCSignal_h
+// -*- C++ -*-
+//
+// Package:    MiniCSC/MiniCSC
+// Class:      MiniCSCSignal
+//
+/**\class MiniCSCSignal MiniCSCSignal.h MiniCSC/MiniCSC/interface/MiniCSCSignal.h
+
+ Description: Strip signal, cluster walk and channel mask file shared by MiniCSC and MiniCSCSkimFilter
+
+ Implementation:
+     A strip has fired if any time bin is more than the ADC threshold above its pedestal, and its charge is the
+     pedestal subtracted sum of all time bins. A cluster is a run of fired digis next to each other in the digi
+     vector of a layer, see walkStripClusters. Masked strips are never part of a cluster.
+     Keeping this in one place means the skim selects events with the clusters the analysis would plot.
+*/
+//
+// Original Author:  Dylan Parks
+//
+//
+
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace minicscsignal {
+
+  /// True if any time bin is more than threshold ADC above the pedestal
+  inline bool hasSignal(const std::vector<int> &adcCounts, float pedestal, uint32_t threshold) {
+    for (const int adc : adcCounts) {
+      if (adc - pedestal > threshold) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /// Pedestal subtracted sum of all time bins
+  inline float stripCharge(const std::vector<int> &adcCounts, float pedestal) {
+    float charge = 0.f;
+    for (const int adc : adcCounts) {
+      charge += adc - pedestal;
+    }
+    return charge;
+  }
+
+  /// Walks the strip digis of one layer cluster by cluster. A cluster starts at an unmasked digi and goes on over the
+  /// next digi in the vector (whatever its strip number) as long as the current strip fired and the next one is not
+  /// masked, so the first quiet strip is the last digi of its cluster.
+  /// @param masked true if the strip of a digi is in the channel mask
+  /// @param onMasked called for each masked digi skipped between clusters
+  /// @param onStrip called for each digi of a cluster, returns whether the strip fired
+  /// @param onCluster called after the last digi of each cluster
+  template <class Iterator, class Masked, class OnMasked, class OnStrip, class OnCluster>
+  inline void walkStripClusters(
+      Iterator stripIt, Iterator last, Masked &&masked, OnMasked &&onMasked, OnStrip &&onStrip, OnCluster &&onCluster) {
+    while (stripIt != last) {
+      if (masked(*stripIt)) {
+        onMasked(*stripIt);
+        ++stripIt;
+        continue;
+      }
+      bool nextStrip = true;
+      while (nextStrip) {
+        const bool fired = onStrip(*stripIt);
+        ++stripIt;
+        nextStrip = fired && stripIt != last && !masked(*stripIt);
+      }
+      onCluster();
+    }
+  }
+
+  /// Reads a channel mask file, one channel per line: <strip|wire> <layer 1-6> <channel> <hot|dead>. Lines starting
+  /// with # are comments, bad lines are reported and skipped.
+  /// @param add called as add(isStrip, layer 0-5, channel, isHot) for every good line
+  /// @return the number of channels read, -1 if the file could not be opened
+  template <class Add>
+  inline int readChannelMaskFile(const std::string &fileName, int numLayers, int numChannels, Add &&add) {
+    std::ifstream in(fileName);
+    if (!in) {
+      return -1;
+    }
+    std::string line, type, flag;
+    int layer, channel;
+    int numRead = 0;
+    while (std::getline(in, line)) {
+      if (line.empty() || line[0] == '#') {
+        continue;
+      }
+      std::istringstream fields(line);
+      if (!(fields >> type >> layer >> channel >> flag) || layer < 1 || layer > numLayers || channel < 0 ||
+          channel >= numChannels || (type != "strip" && type != "wire") || (flag != "hot" && flag != "dead")) {
+        std::cout << "Skipping bad channel mask line: " << line << std::endl;
+        continue;
+      }
+      add(type == "strip", layer - 1, channel, flag == "hot");
+      numRead++;
+    }
+    return numRead;
+  }
+
+}  // namespace minicscsignal
+
+#endif
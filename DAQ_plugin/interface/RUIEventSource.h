@@ -0,0 +1,41 @@
+#ifndef MiniCSC_MiniCSC_RUIEventSource_h
+#define MiniCSC_MiniCSC_RUIEventSource_h
+// -*- C++ -*-
+//
+// Package:    MiniCSC/MiniCSC
+// Class:      RUIEventSource
+//
+/**\class RUIEventSource RUIEventSource.h MiniCSC/MiniCSC/interface/RUIEventSource.h
+
+ Description: Stream of DDU events of one RUI, from raw files (RUIPrefetcher) or archives (MiniCSCArchive)
+*/
+//
+// Original Author:  Dylan Parks
+//
+//
+
+#include <cstddef>
+#include <cstdint>
+
+class RUIEventSource {
+public:
+  virtual ~RUIEventSource() = default;
+
+  /// Next complete DDU event, valid until the following call. Returns false once every file is exhausted.
+  virtual bool next(const uint16_t *&event, size_t &words) = 0;
+
+  /// Skips the next numEvents events, sources with an index can do better than reading through them
+  virtual void skip(uint64_t numEvents) {
+    const uint16_t *event;
+    size_t words;
+    for (uint64_t i = 0; i < numEvents && next(event, words); i++) {
+    }
+  }
+
+  /// Events that could not be read (truncated, oversized)
+  virtual uint64_t droppedEvents() const = 0;
+  /// Times next() had to wait for background reading/decompression, i.e. the job was I/O bound
+  virtual uint64_t stalls() const = 0;
+};
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef MiniCSC_MiniCSC_RUIPrefetcher_h
+#define MiniCSC_MiniCSC_RUIPrefetcher_h
+// -*- C++ -*-
+//
+// Package:    MiniCSC/MiniCSC
+// Class:      RUIPrefetcher
+//
+/**\class RUIPrefetcher RUIPrefetcher.h MiniCSC/MiniCSC/interface/RUIPrefetcher.h
+
+ Description: Reads the raw files of one RUI on a background thread and hands out complete DDU events
+
+ Implementation:
+     The thread reads large blocks into a ring of buffers and splits each block into DDU events (header 2 and
+     trailer 1 markers, same framing as FileReaderDDU). An event cut by the end of a block is copied in front of the
+     next block, so every event handed out is contiguous and points straight into a buffer, no per event copy.
+     A buffer goes back to the thread once the consumer asks for an event past its last one.
+     Each buffer keeps maxEventBytes of headroom in front of the read area for that carried-over tail, so the read
+     itself always starts on a page boundary (needed for O_DIRECT).
+*/
+//
+// Original Author:  Dylan Parks
+//
+//
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "MiniCSC/MiniCSC/interface/RUIEventSource.h"
+
+class RUIPrefetcher : public RUIEventSource {
+public:
+  /// Files are read in order, as if they were one stream
+  RUIPrefetcher(const std::vector<std::string> &files,
+                size_t blockBytes,
+                size_t maxEventBytes,
+                unsigned int numBuffers,
+                bool directIO);
+  ~RUIPrefetcher() override;
+
+  RUIPrefetcher(const RUIPrefetcher &) = delete;
+  RUIPrefetcher &operator=(const RUIPrefetcher &) = delete;
+
+  /// Rethrows anything the reading thread ran into
+  bool next(const uint16_t *&event, size_t &words) override;
+
+  /// Events dropped because they were cut by the end of a file or longer than maxEventBytes
+  uint64_t droppedEvents() const override { return dropped_; }
+  uint64_t stalls() const override { return stalls_; }
+
+private:
+  struct Buffer {
+    /// 64-bit words, page aligned: headroom_ words of carry space, then the read area
+    uint64_t *data = nullptr;
+    /// Event data starts at data + begin (begin < headroom_ when a tail was carried over) and ends at data + end
+    size_t begin = 0, end = 0;
+    /// (offset, length) of every complete event, in 64-bit words from data
+    std::vector<std::pair<size_t, size_t>> events;
+    /// Set on the buffer after the last one, tells next() to stop
+    bool last = false;
+  };
+
+  void readLoop();
+  /// Fills the read area of buffer from fd, returns the number of 64-bit words read (0 at end of file)
+  size_t fill(int fd, Buffer &buffer);
+  /// Splits [begin, end) into events, returns the offset of the unfinished event at the end
+  size_t frame(Buffer &buffer);
+  Buffer *takeFree();
+  void publish(Buffer *buffer);
+
+  const std::vector<std::string> files_;
+  const bool directIO_;
+  /// In 64-bit words
+  size_t headroom_, blockWords_;
+  std::vector<Buffer> buffers_;
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::deque<Buffer *> free_, filled_;
+  bool stop_ = false;
+  std::exception_ptr error_;
+  std::thread thread_;
+
+  /// Consumer side
+  Buffer *current_ = nullptr;
+  size_t eventIndex_ = 0;
+  uint64_t stalls_ = 0;
+  std::atomic<uint64_t> dropped_{0};
+};
+
+#endif
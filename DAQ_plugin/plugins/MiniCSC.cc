@@ -22,6 +22,23 @@
 #include <cstring>
 #include <cstdint>
 #include <cstring>
+#include <chrono>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <cstdio>
+#include <cmath>
+#include <fstream>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 // user include files
 #include "FWCore/Framework/interface/Frameworkfwd.h"
@@ -31,12 +48,16 @@
 #include "FWCore/Framework/interface/MakerMacros.h"
 
 #include "FWCore/ParameterSet/interface/ParameterSet.h"
+#include "FWCore/Utilities/interface/Exception.h"
 #include "FWCore/Utilities/interface/InputTag.h"
 
 #include <FWCore/Framework/interface/ESHandle.h>
 #include <Geometry/Records/interface/MuonGeometryRecord.h>
 #include <RtypesCore.h>
 
+#include "DataFormats/FEDRawData/interface/FEDHeader.h"
+#include "DataFormats/FEDRawData/interface/FEDNumbering.h"
+#include "DataFormats/FEDRawData/interface/FEDRawDataCollection.h"
 #include "DataFormats/MuonDetId/interface/CSCDetId.h"
 
 #include "DataFormats/CSCDigi/interface/CSCCLCTDigi.h"
@@ -46,11 +67,24 @@
 #include "DataFormats/CSCDigi/interface/CSCWireDigi.h"
 #include "DataFormats/CSCDigi/interface/CSCWireDigiCollection.h"
 
+#include "MiniCSC/MiniCSC/interface/CSCChamberGeometry.h"
+#include "MiniCSC/MiniCSC/interface/CSCPulseTemplate.h"
+#include "MiniCSC/MiniCSC/interface/CountHistogram.h"
+#include "MiniCSC/MiniCSC/interface/MiniCSCSignal.h"
+
 // Root includes
+#include "Compression.h"
+#include "TClass.h"
 #include "TFile.h"
 #include "TH1.h"
 #include "TH2.h"
+#include "TKey.h"
+#include "TMemFile.h"
+#include "TNamed.h"
+#include "TParameter.h"
 #include "TProfile.h"
+#include "TProfile2D.h"
+#include "TVirtualStreamerInfo.h"
 
 //
 // class declaration
@@ -64,7 +98,7 @@
 class MiniCSC : public edm::one::EDAnalyzer<edm::one::SharedResources> {
 public:
   explicit MiniCSC(const edm::ParameterSet &);
-  // ~MiniCSC() override;
+  ~MiniCSC() override;
 
   // Tags and tokens
   edm::InputTag stripDigiTag;
@@ -73,22 +107,186 @@ public:
   edm::EDGetTokenT<CSCStripDigiCollection> cscStripToken;
   edm::EDGetTokenT<CSCWireDigiCollection> cscWireToken;
   edm::EDGetTokenT<CSCCLCTDigiCollection> cscCLCTToken;
+  /// Raw data, only read for the L1A/BXN of the afterpulse analysis
+  edm::EDGetTokenT<FEDRawDataCollection> rawDataToken;
 
 private:
   // Basic Fields ===================================================
 
-  /// Stores various values for histogram sizing
+  /// Stores various values for histogram sizing, set from the chamber geometry
   float wiregroupHigh, wiregroupLow, numWiregroup, stripHigh, stripLow, numStrip, numHalfStrip;
+  /// Chamber being analyzed, picks the cscgeometry traits the per-event code is compiled for
+  std::string chamberType_;
 
   /// Defines how many strips to plot for charge spectra. 3-5 works best. Higher values allow in more noise from strips that were not actually hit.
   uint32_t stripWidthChg_;
+  /// Rebin factors of the coarser charge spectra written next to the full resolution ones, and their directories
+  std::vector<uint32_t> chargePyramidLevels_;
+  std::vector<std::string> chargePyramidDirs_;
   /// How much higher than pedestal must a strip time bin be to be valid signal
   uint32_t adcThres_;
+  /// Strip charge for the charge spectra: sum of all time bins, or the charge of the fitted pulse template
+  bool templateCharge_;
+  /// CFEB shaper template, fitted to every strip with signal for its amplitude and peak time
+  const CSCPulseTemplate pulseTemplate_;
 
   // Constants
 
-  /// Number of layers in a standard CSC
+  /// Number of layers in a standard CSC, every chamber geometry has to match it
   static const uint16_t numLayers = 6;
+  /// Size of the per-layer channel mask and occupancy counters. Covers the strip numbers after the ring 4 offset.
+  static const uint16_t kMaxChannels = 256;
+
+  // Channel Masking
+
+  /// Hot/dead channels of one kind (strips or wiregroups), indexed by layer then channel number.
+  /// Flags are sticky: a masked channel is skipped before it is counted, so it can never look healthy again.
+  struct ChannelMask {
+    std::bitset<kMaxChannels> hot[numLayers];
+    std::bitset<kMaxChannels> dead[numLayers];
+    /// hot | dead, the only bits tested in the event loop
+    std::bitset<kMaxChannels> masked[numLayers];
+    /// Hits per channel in the current monitoring window
+    uint32_t counts[numLayers][kMaxChannels] = {};
+
+    bool test(uint16_t layer, int channel) const {
+      return channel >= 0 && channel < kMaxChannels && masked[layer][channel];
+    }
+    void count(uint16_t layer, int channel) {
+      if (channel >= 0 && channel < kMaxChannels) {
+        counts[layer][channel]++;
+      }
+    }
+    /// Flags channels of the finished window against the median occupancy of their layer and resets the counters
+    void update(double hotFactor, double deadFactor, uint32_t minHotCounts);
+  };
+
+  /// Channels above hotChannelFactor x layer median (and at least minHotCounts hits) in a window are hot
+  double hotChannelFactor_;
+  /// Channels below deadChannelFactor x layer median, inside the layer's fired range, are dead
+  double deadChannelFactor_;
+  uint32_t minHotCounts_;
+  /// Events per occupancy monitoring window, 0 disables the monitor (a mask file is still applied)
+  uint32_t maskWindowEvents_;
+  /// Mask read at construction and mask written at the end of the job, empty to skip
+  std::string channelMaskFile_, channelMaskOutputFile_;
+  ChannelMask stripMask_, wireMask_;
+  void readChannelMask(const std::string &fileName);
+  void writeChannelMask(const std::string &fileName) const;
+
+  // Anode-Cathode Matching
+
+  /// Anode time bins in a wire digi, one per bunch crossing
+  static const uint16_t kNumAnodeTimeBins = 16;
+  /// ns per bunch crossing, converts the cathode pulse time to anode time bins
+  static constexpr float kBunchSpacing = 25.f;
+  /// Adjacent fired strips or wiregroups in one layer
+  struct HitCluster {
+    /// Charge weighted strip number, or central wiregroup
+    float position;
+    /// Sum of the strip charges, 0 for wiregroups
+    float charge;
+    /// Bunch crossing: anode time bin, or the pulse peak time of the highest strip
+    int bx;
+  };
+  /// Clusters of the current event. Cleared, never shrunk, so steady state filling does not allocate.
+  std::vector<HitCluster> cathodeClusters_[numLayers], anodeClusters_[numLayers];
+  /// Anode clusters bucketed by time bin: first cluster of each bin and the next cluster in the same bin
+  int bucketHead_[kNumAnodeTimeBins];
+  std::vector<int> bucketNext_;
+  /// Largest |anode bx - cathode bx| of a matched pair
+  uint32_t coincidenceWindowBX_;
+  /// Added to the cathode bx before the comparison, the anode/cathode timing offset of the readout
+  int cathodeTimeOffsetBX_;
+
+  // Dark Rate
+
+  /// Live time is one readout window per (random) trigger. The raw data has no clock to measure the time between
+  /// events with: EmptySource makes up the event time and orbit, and the DDU/DMB BXN wraps every orbit.
+  enum DarkRateMode { kDarkRateOff = 0, kDarkRateWindow };
+  DarkRateMode darkRateMode_;
+  /// Live time per event, s
+  double darkRateWindow_;
+  /// Events between flushes of the hit counters into the rate profiles
+  uint32_t darkRateFlushEvents_;
+  /// Areas for the Hz/cm^2 normalization
+  double stripArea_, wiregroupArea_, layerArea_;
+  /// Hits since the last flush
+  uint32_t darkStripHits_[numLayers][kMaxChannels] = {};
+  uint32_t darkWireHits_[numLayers][kMaxChannels] = {};
+  /// Live time since the last flush and over the whole job, s
+  double darkLiveTime_ = 0., darkTotalLiveTime_ = 0.;
+  /// Fills the rates of the counted hits, weighted by their live time, and resets the counters
+  void flushDarkRates();
+
+  // Afterpulse Analysis
+
+  /// Bunch crossings per LHC orbit, the BXN counts modulo this
+  static const int kBXPerOrbit = 3564;
+  /// What is kept of an event for the cross-event correlations
+  struct EventSummary {
+    /// L1A number (24 bits) and bunch crossing (12 bits, wraps every orbit) from the CDF header of the DDU/DCC
+    uint32_t l1a;
+    uint16_t bxn;
+    uint16_t firedStrips[numLayers];
+    float maxClusterCharge[numLayers];
+  };
+  /// The last afterpulseDepth events, allocated once. ringHead_ is the slot the next event goes into.
+  std::vector<EventSummary> eventRing_;
+  size_t ringHead_ = 0, ringSize_ = 0;
+  /// Cluster charge above which a layer counts as a high charge signal
+  double afterpulseChargeThreshold_;
+  /// Fired strips per layer in the current event
+  uint16_t firedStripsInLayer_[numLayers];
+  /// Compares this event with the ones in the ring, then adds it to the ring. Events without a CSC FED are skipped.
+  void handleAfterpulses(const edm::Event &iEvent);
+
+  // Checkpointing
+
+  /// Side file holding the accumulated state of the job, empty to disable
+  std::string checkpointFile_;
+  /// Events between checkpoints
+  uint32_t checkpointEvents_;
+  /// Start from the checkpoint. The source skips the events it already holds except the last one (skipEvents, set
+  /// by analyzeCSCdigis.py), which is only compared with the id the checkpoint ended at.
+  bool resume_;
+  /// The next event is the last one of the checkpoint, and the id it should have
+  bool resumeCheck_ = false;
+  edm::EventID resumeLastId_;
+  edm::EventID lastEventId_;
+  uint32_t numCheckpoints = 0, numCheckpointsSkipped = 0;
+  /// Copies the histograms and counters and hands them to writerThread_
+  void writeCheckpoint();
+  /// Adds the checkpoint into the freshly booked histograms and restores the counters
+  void readCheckpoint();
+
+  // Output writing
+
+  /// ROOT compression settings (algorithm * 100 + level) of the output, snapshots and checkpoints
+  int outputCompression_;
+  /// Threads that stream and compress the output histograms, 1 writes them one after the other
+  unsigned int outputThreads_;
+  /// Events between snapshots of the output file, 0 = off
+  uint32_t snapshotEvents_;
+  std::string snapshotFile_;
+  uint32_t numSnapshots = 0, numSnapshotsSkipped = 0;
+  /// Writes checkpoints and snapshots, at most one at a time
+  std::thread writerThread_;
+  std::atomic<bool> writerBusy_{false};
+  /// Histogram and the output directory it goes to
+  struct OutputEntry {
+    const char *dir;
+    TH1 *hist;
+  };
+  /// Every histogram of the output in file order. CountHistograms and the mask flags are made into ROOT histograms
+  /// here, owned by owned.
+  std::vector<OutputEntry> outputEntries(std::vector<std::unique_ptr<TH1>> &owned) const;
+  /// Writes the entries into file, whose directories must exist
+  void writeOutput(TFile *file, const std::vector<OutputEntry> &entries) const;
+  /// Copies the output histograms and writes them to snapshotFile_ on writerThread_
+  void writeSnapshot();
+  /// True once the previous background write is done, without waiting for it
+  bool writerIdle();
 
   // Used mainly for debugging
 
@@ -96,6 +294,19 @@ private:
   uint32_t numEmpty = 0;
   /// Total number of events processed
   uint64_t numEventsProc = 0;
+  /// Digis skipped by the channel mask
+  uint64_t numMaskedStrips = 0, numMaskedWires = 0;
+  /// Cathode clusters matched to an anode cluster, and those with two anode candidates
+  uint64_t numMatches = 0, numAmbiguousMatches = 0;
+
+  // Instrumentation
+
+  /// Analysis stages timed in every event
+  enum Stage { kAnode = 0, kCathode, kCLCT, kMatch, kAfterpulse, kNumStages };
+  /// Accumulated ticks (TSC on x86, steady_clock otherwise) per stage over the whole job
+  uint64_t stageTicks[kNumStages] = {};
+  /// Cheap timestamp for the stage counters
+  static uint64_t stageClock();
 
   // Output Fields ==================================================
 
@@ -105,39 +316,96 @@ private:
   TFile *fout;
 
   // Histograms =====================================================
-  // TODO: Some of these do not need to be floats/doubles. Also some of these graphs are really bad and warrant removal.
+  // Histograms that only count are CountHistograms (32-bit bins), they become the ROOT type in their template argument
+  // when written. TODO: Some of these graphs are really bad and warrant removal.
+
+  /// Every CountHistogram, for the checkpoints
+  std::vector<CountHistogramBase *> countHistograms_;
+  /// Every booked ROOT histogram, for the checkpoints. cmsRun turns TH1::AddDirectory off, so fout does not list them.
+  std::vector<TH1 *> rootHistograms_;
 
   // Anode Histograms
 
   /// Wiregroup occupancy for each layer
-  TH1D *wire[numLayers];
+  CountHistogram<TH1D> *wire[numLayers];
   /// number of "simultaneous" hits from a WG (first WG is assigned to be actual one)
-  TH2F *h2dNofAhitWG[numLayers];
+  CountHistogram<TH2F> *h2dNofAhitWG[numLayers];
   /// Anode vs time bin for each layer, representing when in an event the anodes fire
-  TH2F *anodeFiredTimeBins[numLayers];
+  CountHistogram<TH2F> *anodeFiredTimeBins[numLayers];
   /// How many wiregroups fire during an event
-  TH1I *firedWireGroups;
+  CountHistogram<TH1I> *firedWireGroups;
 
   // Cathode Histograms
 
   /// Strip occupancy for each layer
-  TH1D *strip[numLayers];
+  CountHistogram<TH1D> *strip[numLayers];
   /// Halfstrip occupancy for each layer
-  TH1D *halfStrip[numLayers];
+  CountHistogram<TH1D> *halfStrip[numLayers];
   /// Absolute ADC values for each layer, representing when in an event a strip fires
   TH2F *absADCVal[numLayers];
-  /// Average ADC pedestal value across entire run. This could be a good use for TProfiles
-  TH1F *avgPedestals[numLayers];
-  /// First sample of pedestal for entire run
-  TH1F *fstPedestal[numLayers];
+  // The pedestal histograms are accumulators (sum, sum of squares and count per strip in a TProfile), so outputs of
+  // split jobs can be added. Averages and RMS are derived on read, see MiniCSCData.
+
+  /// Pedestal of every strip digi, mean and RMS per strip
+  TProfile *pedestal[numLayers];
+  /// First sampled pedestal of each strip in this job. Merged outputs average the first pedestals of their jobs.
+  TProfile *firstPedestal[numLayers];
+  /// Strips that already have their first pedestal
+  std::bitset<kMaxChannels> firstPedestalSeen_[numLayers];
   /// Charge spectra for each layer
-  TH1D *charges[numLayers];
+  CountHistogram<TH1D> *charges[numLayers];
   /// How many strips fire during an event
-  TH1I *firedStrips;
+  CountHistogram<TH1I> *firedStrips;
   /// Time bin distribution for all strips in all layers. Shows where in each event a strip fires
   TProfile *chargeTBinProfile;
   /// Maybe represents average charge for fired strip width. Data wasn't super useful but you can have this graph now :)
   TProfile *firedStripsADC;
+  /// Fitted pulse peak time of fired strips for each layer
+  TH1F *pulseTime[numLayers];
+  /// Fraction of the strip signal explained by the pulse template, all layers
+  TH1F *pulseQuality;
+
+  // CLCT Histograms
+
+  /// CLCT pattern id and bend (0 = left, 1 = right) per layer, filled with halfStrip
+  CountHistogram<TH1I> *clctPattern[numLayers];
+  CountHistogram<TH1I> *clctBend[numLayers];
+
+  // Coincidence Histograms
+
+  /// Mean cathode cluster charge at each (strip, wiregroup) crossing of matched clusters, per layer
+  TProfile2D *gainMap[numLayers];
+  /// Anode minus cathode bx in layers with one cluster of each, for setting cathodeTimeOffsetBX
+  TH1F *coincidenceTimeDiff;
+
+  // Dark Rate Histograms
+  // Profiles weighted by live time: the mean of a bin is (sum of hits) / (sum of live time), so they stay correct
+  // when split jobs are merged with hadd.
+
+  /// Rate per strip for each layer, Hz/cm^2
+  TProfile *stripRate[numLayers];
+  /// Rate per wiregroup for each layer, Hz/cm^2
+  TProfile *wireRate[numLayers];
+  /// Anode rate of each layer, Hz/cm^2
+  TProfile *layerRate;
+  /// Total live time, s
+  TH1D *liveTime;
+
+  // Afterpulse Histograms
+  // Occupancy of a layer after an earlier event with a signal in the same layer, split by the earlier cluster charge.
+  // The low charge profiles are the reference for the excess after large signals.
+
+  /// Time to the previous event, modulo one orbit (the BXN has no orbit counter above it)
+  TH1D *interEventTime;
+  /// Fired strips vs time since an earlier high/low charge signal, modulo one orbit
+  TProfile *occupancyAfterHighTime, *occupancyAfterLowTime;
+  /// Fired strips vs number of triggers (L1A difference) since an earlier high/low charge signal
+  TProfile *occupancyAfterHighEvents, *occupancyAfterLowEvents;
+
+  // Timing Histograms
+
+  /// Average ticks per event spent in each analysis stage
+  TProfile *stageTicksProfile;
 
   // Methods ======================================================
 
@@ -148,13 +416,34 @@ private:
   // Called after entire run has been analyzed
   void endJob() override;
   /// Handles all anode analysis
+  template <class Geometry>
   void handleAnodes(const edm::Handle<CSCWireDigiCollection> wires);
-  /// Handles all cathode analysis (strip and halfstrip collections)
-  void handleCathodes(const edm::Handle<CSCStripDigiCollection> strips, const edm::Handle<CSCCLCTDigiCollection> clct);
+  /// Handles strip analysis
+  template <class Geometry>
+  void handleCathodes(const edm::Handle<CSCStripDigiCollection> strips);
+  /// Handles halfstrip analysis from the CLCT collection
+  template <class Geometry>
+  void handleCLCTs(const edm::Handle<CSCCLCTDigiCollection> clct);
+  /// CFEB numbers a CLCT digi can carry (3-bit field)
+  static const uint16_t kNumCFEBSlots = 8;
+  /// CFEB of a CLCT -> layer whose halfStrip histogram it fills, -1 if it has none. Built by setGeometry.
+  std::array<int8_t, kNumCFEBSlots> cfebLayer_;
+  /// CLCTs whose CFEB is not in cfebLayer_
+  uint64_t numUnmappedCLCTs = 0;
+  /// The handlers compiled for the configured chamber
+  void (MiniCSC::*anodeHandler_)(const edm::Handle<CSCWireDigiCollection>);
+  void (MiniCSC::*cathodeHandler_)(const edm::Handle<CSCStripDigiCollection>);
+  void (MiniCSC::*clctHandler_)(const edm::Handle<CSCCLCTDigiCollection>);
+  /// Points the handlers and the histogram ranges at one chamber geometry
+  template <class Geometry>
+  void setGeometry();
+  /// Pairs the cathode and anode clusters of each layer found by handleCathodes and handleAnodes
+  void matchClusters();
 };
 
 // Constructor only grabs config options from the caller. Initialization happens in MiniCSC::beginJob.
-MiniCSC::MiniCSC(const edm::ParameterSet &iConfig) {
+MiniCSC::MiniCSC(const edm::ParameterSet &iConfig)
+    : pulseTemplate_(iConfig.getUntrackedParameter<double>("pulsePeakingTime", 100.)) {
   // Reading all event tags from the python config
   stripDigiTag = iConfig.getParameter<edm::InputTag>("stripDigiTag");
   wireDigiTag = iConfig.getParameter<edm::InputTag>("wireDigiTag");
@@ -168,18 +457,140 @@ MiniCSC::MiniCSC(const edm::ParameterSet &iConfig) {
   std::cout << "Output filename: " << theRootFileName << std::endl;
   stripWidthChg_ = iConfig.getParameter<uint32_t>("stripWidthCharges");
   std::cout << "Charge Spectra Strip Width: " << stripWidthChg_ << std::endl;
+  // Readers fetch the level they would otherwise rebin the full spectrum to, so they have to divide it evenly
+  chargePyramidLevels_ = iConfig.getUntrackedParameter<std::vector<uint32_t>>("chargePyramidLevels",
+                                                                              std::vector<uint32_t>{4, 16, 32, 128});
+  for (const uint32_t level : chargePyramidLevels_) {
+    if (level < 2 || (stripWidthChg_ * 4096) % level != 0) {
+      throw cms::Exception("Configuration") << "chargePyramidLevels: " << level << " does not divide the "
+                                            << stripWidthChg_ * 4096 << " charge spectrum bins";
+    }
+    chargePyramidDirs_.push_back("/Cathode/chargeRebin" + std::to_string(level) + "/");
+  }
   adcThres_ = iConfig.getParameter<uint32_t>("adcThreshold");
   std::cout << "ADC Threshold: " << adcThres_ << std::endl;
+  const std::string chargeMethod = iConfig.getUntrackedParameter<std::string>("chargeMethod", "sum");
+  if (chargeMethod != "sum" && chargeMethod != "template") {
+    throw cms::Exception("Configuration") << "chargeMethod must be \"sum\" or \"template\", not " << chargeMethod;
+  }
+  templateCharge_ = chargeMethod == "template";
+  std::cout << "Strip charge: " << chargeMethod << std::endl;
+
+  // Channel masking
+  channelMaskFile_ = iConfig.getUntrackedParameter<std::string>("channelMaskFile", "");
+  channelMaskOutputFile_ = iConfig.getUntrackedParameter<std::string>("channelMaskOutputFile", "");
+  maskWindowEvents_ = iConfig.getUntrackedParameter<uint32_t>("maskWindowEvents", 0);
+  hotChannelFactor_ = iConfig.getUntrackedParameter<double>("hotChannelFactor", 10.);
+  deadChannelFactor_ = iConfig.getUntrackedParameter<double>("deadChannelFactor", 0.05);
+  minHotCounts_ = iConfig.getUntrackedParameter<uint32_t>("minHotCounts", 20);
+  if (!channelMaskFile_.empty()) {
+    readChannelMask(channelMaskFile_);
+  }
+  if (maskWindowEvents_ > 0) {
+    std::cout << "Channel mask monitoring window: " << maskWindowEvents_ << " events" << std::endl;
+  }
+
+  // Anode-cathode matching
+  coincidenceWindowBX_ = iConfig.getUntrackedParameter<uint32_t>("coincidenceWindowBX", 2);
+  cathodeTimeOffsetBX_ = iConfig.getUntrackedParameter<int>("cathodeTimeOffsetBX", 0);
+
+  // Dark rate
+  const std::string darkRateMode = iConfig.getUntrackedParameter<std::string>("darkRateMode", "");
+  if (darkRateMode.empty()) {
+    darkRateMode_ = kDarkRateOff;
+  } else if (darkRateMode == "window") {
+    darkRateMode_ = kDarkRateWindow;
+  } else {
+    throw cms::Exception("Configuration") << "darkRateMode must be empty or \"window\", not " << darkRateMode;
+  }
+  darkRateWindow_ = iConfig.getUntrackedParameter<double>("darkRateWindowNs", 400.) * 1e-9;
+  darkRateFlushEvents_ = iConfig.getUntrackedParameter<uint32_t>("darkRateFlushEvents", 10000);
+  stripArea_ = iConfig.getUntrackedParameter<double>("stripAreaCm2", 1.);
+  wiregroupArea_ = iConfig.getUntrackedParameter<double>("wiregroupAreaCm2", 1.);
+  layerArea_ = iConfig.getUntrackedParameter<double>("layerAreaCm2", 1.);
+  if (darkRateMode_ != kDarkRateOff) {
+    std::cout << "Dark rate mode: " << darkRateMode << std::endl;
+  }
+
+  // Afterpulses
+  eventRing_.resize(iConfig.getUntrackedParameter<uint32_t>("afterpulseDepth", 0));
+  afterpulseChargeThreshold_ = iConfig.getUntrackedParameter<double>("afterpulseChargeThreshold", 2000.);
+  if (!eventRing_.empty()) {
+    rawDataToken = consumes<FEDRawDataCollection>(iConfig.getParameter<edm::InputTag>("rawDataTag"));
+    std::cout << "Afterpulse analysis over the last " << eventRing_.size() << " events" << std::endl;
+  }
+
+  // Checkpoints
+  checkpointFile_ = iConfig.getUntrackedParameter<std::string>("checkpointFile", "");
+  checkpointEvents_ = iConfig.getUntrackedParameter<uint32_t>("checkpointEvents", 100000);
+  resume_ = iConfig.getUntrackedParameter<bool>("resumeFromCheckpoint", false);
+  if (!checkpointFile_.empty()) {
+    std::cout << "Checkpoint every " << checkpointEvents_ << " events to " << checkpointFile_ << std::endl;
+  }
+
+  // Output compression and writing
+  const std::string compression = iConfig.getUntrackedParameter<std::string>("outputCompression", "zlib");
+  ROOT::RCompressionSetting::EAlgorithm::EValues algorithm;
+  if (compression == "zlib") {
+    algorithm = ROOT::RCompressionSetting::EAlgorithm::kZLIB;
+  } else if (compression == "lz4") {
+    algorithm = ROOT::RCompressionSetting::EAlgorithm::kLZ4;
+  } else if (compression == "zstd") {
+    algorithm = ROOT::RCompressionSetting::EAlgorithm::kZSTD;
+  } else if (compression == "lzma") {
+    algorithm = ROOT::RCompressionSetting::EAlgorithm::kLZMA;
+  } else {
+    throw cms::Exception("Configuration") << "outputCompression must be zlib, lz4, zstd or lzma, not " << compression;
+  }
+  outputCompression_ =
+      ROOT::CompressionSettings(algorithm, iConfig.getUntrackedParameter<int>("outputCompressionLevel", 1));
+  outputThreads_ = std::max(iConfig.getUntrackedParameter<uint32_t>("outputThreads", 1), 1u);
+  snapshotEvents_ = iConfig.getUntrackedParameter<uint32_t>("snapshotEvents", 0);
+  snapshotFile_ = theRootFileName.substr(0, theRootFileName.rfind(".root")) + "_snapshot.root";
+  snapshotFile_ = iConfig.getUntrackedParameter<std::string>("snapshotFile", snapshotFile_);
+  if (snapshotEvents_ > 0) {
+    std::cout << "Snapshot every " << snapshotEvents_ << " events to " << snapshotFile_ << std::endl;
+  }
+  // Histogram bounds and per-event code for the chamber
+  chamberType_ = iConfig.getUntrackedParameter<std::string>("chamberType", cscgeometry::MiniCSC::kName);
+  cscgeometry::dispatchGeometry(chamberType_, [this](auto geometry) { setGeometry<decltype(geometry)>(); });
+  std::cout << "Chamber: " << chamberType_ << ", " << numStrip << " strips, " << numWiregroup << " wiregroups"
+            << std::endl;
+}
+
+template <class Geometry>
+void MiniCSC::setGeometry() {
+  static_assert(Geometry::kNumLayers == numLayers, "per-layer arrays are sized for numLayers");
+  static_assert(Geometry::kNumStrips < kMaxChannels && Geometry::kNumWiregroups < kMaxChannels,
+                "channel masks and rate counters are sized for kMaxChannels");
+  anodeHandler_ = &MiniCSC::handleAnodes<Geometry>;
+  cathodeHandler_ = &MiniCSC::handleCathodes<Geometry>;
+  clctHandler_ = &MiniCSC::handleCLCTs<Geometry>;
 
-  // Set up histogram bounds
-  // TODO: Use config for these?
-  wiregroupHigh = 120.5;
   wiregroupLow = 0.5;
+  wiregroupHigh = Geometry::kNumWiregroups + 0.5;
   numWiregroup = wiregroupHigh - wiregroupLow;
-  stripHigh = 120.5;
   stripLow = 0.5;
+  stripHigh = Geometry::kNumStrips + 0.5;
   numStrip = stripHigh - stripLow;
-  numHalfStrip = 225;
+  numHalfStrip = Geometry::kNumHalfStrips;
+
+  // Keeps the assignment the halfstrip plots always had (CFEB 2 -> layer 1, CFEB 3 -> layer 2, ...), but only for
+  // CFEBs the chamber has and layers that exist, anything else is counted instead of indexing past the histograms
+  const int kFirstCFEB = 2;
+  for (int cfeb = 0; cfeb < kNumCFEBSlots; cfeb++) {
+    const int layer = cfeb - kFirstCFEB;
+    const bool onChamber = cfeb * Geometry::kStripsPerCFEB < Geometry::kNumStrips;
+    cfebLayer_[cfeb] = onChamber && layer >= 0 && layer < numLayers ? layer : -1;
+  }
+}
+
+uint64_t MiniCSC::stageClock() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
 }
 
 // ------------ method called once each job just before starting event loop
@@ -188,7 +599,7 @@ void MiniCSC::beginJob() {
   // Title and name buffers
   char t1[250], t2[250];
   // Setup root file
-  fout = new TFile(theRootFileName.c_str(), "RECREATE");
+  fout = new TFile(theRootFileName.c_str(), "RECREATE", "", outputCompression_);
   fout->cd();
 
   // Creating folder layout within the root file
@@ -200,18 +611,38 @@ void MiniCSC::beginJob() {
   // Cathode Dirs
   fout->mkdir("Cathode/");
   fout->mkdir("Cathode/charge/");
+  for (const std::string &dir : chargePyramidDirs_) {
+    fout->mkdir(dir.c_str() + 1);
+  }
   fout->mkdir("Cathode/stripTBinADCVal/");
   fout->mkdir("Cathode/strip/");
   fout->mkdir("Cathode/halfStrip/");
-  fout->mkdir("Cathode/avgPedestal/");
-  fout->mkdir("Cathode/fstPedestal/");
+  fout->mkdir("Cathode/pedestal/");
+  fout->mkdir("Cathode/firstPedestal/");
+  fout->mkdir("Cathode/pulseTime/");
+  // Anode-cathode coincidence Dirs
+  fout->mkdir("CLCT/");
+  fout->mkdir("CLCT/pattern/");
+  fout->mkdir("CLCT/bend/");
+
+  fout->mkdir("Coincidence/");
+  fout->mkdir("Coincidence/gainMap/");
+  // Dark rate Dirs
+  fout->mkdir("DarkRate/");
+  fout->mkdir("DarkRate/stripRate/");
+  fout->mkdir("DarkRate/wireRate/");
+  fout->mkdir("Afterpulse/");
+  // Instrumentation Dirs
+  fout->mkdir("Timing/");
+  // Channel mask used for this output
+  fout->mkdir("Mask/");
 
   // Plots for each layer
   for (int i = 0; i < numLayers; i++) {
     // Anode plots
     sprintf(t1, "wireL%d", i + 1);
     sprintf(t2, "Wiregroup Occupancy for Layer = %d;Anode Wiregroup;Number of events", i + 1);
-    wire[i] = new TH1D(t1, t2, numWiregroup, wiregroupLow, wiregroupHigh);
+    wire[i] = new CountHistogram<TH1D>(t1, t2, numWiregroup, wiregroupLow, wiregroupHigh);
 
     // Cathode plots
     sprintf(t1, "chargeL%d", i + 1);
@@ -219,77 +650,515 @@ void MiniCSC::beginJob() {
     // 4096 is the maximum adc value, 1 ADC for each bin,
     // NOTE: I changed numbinsx from 3 * 4096 to stripWidthChg_ * 4096 on the last day.
     // Should be correct but if things are acting weird revert the change and test further.
-    charges[i] = new TH1D(t1, t2, stripWidthChg_ * 4096, 0.5, stripWidthChg_ * 4096 + 0.5);  // 4096, 4095
+    charges[i] =
+        new CountHistogram<TH1D>(t1, t2, stripWidthChg_ * 4096, 0.5, stripWidthChg_ * 4096 + 0.5);  // 4096, 4095
 
     sprintf(t1, "stripL%d", i + 1);
     sprintf(t2, "Strip Occupancy for Layer = %d;Strip;Number of events", i + 1);
-    strip[i] = new TH1D(t1, t2, numStrip, stripLow, stripHigh);
+    strip[i] = new CountHistogram<TH1D>(t1, t2, numStrip, stripLow, stripHigh);
 
     sprintf(t1, "halfStripL%d", i + 1);
     sprintf(t2, "HalfStrip Occupancy for Layer = %d;Cathode HalfStrip;Number of events", i + 1);
-    halfStrip[i] = new TH1D(t1, t2, numHalfStrip, 0.5, numHalfStrip + 0.5);
+    halfStrip[i] = new CountHistogram<TH1D>(t1, t2, numHalfStrip, 0.5, numHalfStrip + 0.5);
 
     sprintf(t1, "stripTBinADCValL%d", i + 1);
     sprintf(t2, "Layer = %d;Time bin;Strip number", i + 1);
     absADCVal[i] = new TH2F(t1, t2, 8, -0.5, 7.5, numStrip, stripLow, stripHigh);
 
-    // TODO: Make RMS pedestal value graph
-    sprintf(t1, "avgPedestalL%d", i + 1);
-    sprintf(t2, "Layer = %d;Strip Number;Average value", i + 1);
-    avgPedestals[i] = new TH1F(t1, t2, numStrip, stripLow, stripHigh);
+    sprintf(t1, "pedestalL%d", i + 1);
+    sprintf(t2, "Layer = %d;Strip Number;Pedestal", i + 1);
+    pedestal[i] = new TProfile(t1, t2, numStrip, stripLow, stripHigh);
 
-    sprintf(t1, "fstPedestalL%d", i + 1);
+    sprintf(t1, "firstPedestalL%d", i + 1);
     sprintf(t2, "Layer = %d;Strip number;First sampled value", i + 1);
-    fstPedestal[i] = new TH1F(t1, t2, numStrip, stripLow, stripHigh);
+    firstPedestal[i] = new TProfile(t1, t2, numStrip, stripLow, stripHigh);
+
+    sprintf(t1, "pulseTimeL%d", i + 1);
+    sprintf(t2, "Strip Pulse Peak Time for Layer = %d;Peak time from time bin 0 [ns];Number of strips", i + 1);
+    pulseTime[i] = new TH1F(t1, t2, 80, 0, CSCPulseTemplate::kNumTimeBins * CSCPulseTemplate::kBinWidth);
+
+    sprintf(t1, "clctPatternL%d", i + 1);
+    sprintf(t2, "CLCT Pattern for Layer = %d;Pattern;Number of CLCTs", i + 1);
+    clctPattern[i] = new CountHistogram<TH1I>(t1, t2, 16, -0.5, 15.5);
+
+    sprintf(t1, "clctBendL%d", i + 1);
+    sprintf(t2, "CLCT Bend for Layer = %d;Bend (0 = left, 1 = right);Number of CLCTs", i + 1);
+    clctBend[i] = new CountHistogram<TH1I>(t1, t2, 2, -0.5, 1.5);
+
+    sprintf(t1, "gainMapL%d", i + 1);
+    sprintf(t2, "Mean Cluster Charge for Layer = %d;Strip;Wiregroup;Mean cluster charge [ADC]", i + 1);
+    gainMap[i] = new TProfile2D(t1, t2, numStrip, stripLow, stripHigh, numWiregroup, wiregroupLow, wiregroupHigh);
+
+    sprintf(t1, "stripRateL%d", i + 1);
+    sprintf(t2, "Strip Rate for Layer = %d;Strip;Rate [Hz/cm^{2}]", i + 1);
+    stripRate[i] = new TProfile(t1, t2, numStrip, stripLow, stripHigh);
+
+    sprintf(t1, "wireRateL%d", i + 1);
+    sprintf(t2, "Wiregroup Rate for Layer = %d;Anode Wiregroup;Rate [Hz/cm^{2}]", i + 1);
+    wireRate[i] = new TProfile(t1, t2, numWiregroup, wiregroupLow, wiregroupHigh);
 
     // Not sure these are useful
     sprintf(t1, "simulAnodeHitL%d", i + 1);
     sprintf(t2, "Layer = %d;Wiregroup;Number of Wiregroups Hit(?)", i + 1);
-    h2dNofAhitWG[i] = new TH2F(t1, t2, numWiregroup, wiregroupLow, wiregroupHigh, 11, -1.5, 9);
+    h2dNofAhitWG[i] = new CountHistogram<TH2F>(t1, t2, numWiregroup, wiregroupLow, wiregroupHigh, 11, -1.5, 9);
 
     sprintf(t1, "firedTBinAnodeL%d", i + 1);
     sprintf(t2, "Layer = %d;Wiregroup;Time bin", i + 1);
-    anodeFiredTimeBins[i] = new TH2F(t1, t2, numWiregroup, wiregroupLow, wiregroupHigh, 16, 0, 16);
+    anodeFiredTimeBins[i] = new CountHistogram<TH2F>(t1, t2, numWiregroup, wiregroupLow, wiregroupHigh, 16, 0, 16);
+
+    countHistograms_.insert(countHistograms_.end(),
+                            {wire[i], charges[i], strip[i], halfStrip[i], h2dNofAhitWG[i], anodeFiredTimeBins[i]});
+    countHistograms_.insert(countHistograms_.end(), {clctPattern[i], clctBend[i]});
   };
 
   sprintf(t1, "chargeTBinProfile");
   sprintf(t2, "MiniCSC average strip signal (>%d ADC) by time for all layers (Qi-(Q0+Q1)/2);Time bin;ADC", adcThres_);
   chargeTBinProfile = new TProfile(t1, t2, 8, -0.5, 7.5);
 
-  firedWireGroups =
-      new TH1I("firedWireGroup", "Number of Fired Wire Groups;Wiregroups;Number of events", 20, 0.5, 20.5);
+  firedWireGroups = new CountHistogram<TH1I>(
+      "firedWireGroup", "Number of Fired Wire Groups;Wiregroups;Number of events", 20, 0.5, 20.5);
 
   sprintf(t2, "Number of Fired Strips, ADC Threshold = %d;Number of Strips;Number of events", adcThres_);
-  firedStrips = new TH1I("firedStrip", t2, 20, 0.5, 20.5);
+  firedStrips = new CountHistogram<TH1I>("firedStrip", t2, 20, 0.5, 20.5);
+  countHistograms_.push_back(firedWireGroups);
+  countHistograms_.push_back(firedStrips);
 
   firedStripsADC = new TProfile("firedStripsADC", "Average Charge per Strip Width;Number of Strips;ADC", 20, 0.5, 20.5);
+
+  pulseQuality = new TH1F(
+      "pulseQuality", "Strip Pulse Template Fit Quality;Fraction of signal explained;Number of strips", 50, 0, 1);
+
+  coincidenceTimeDiff = new TH1F("coincidenceTimeDiff",
+                                 "Anode - Cathode Time, One Cluster of Each;Anode - cathode [bx];Number of layers",
+                                 2 * kNumAnodeTimeBins + 1,
+                                 -kNumAnodeTimeBins - 0.5,
+                                 kNumAnodeTimeBins + 0.5);
+
+  layerRate = new TProfile("layerRate", "Anode Rate by Layer;Layer;Rate [Hz/cm^{2}]", numLayers, 0.5, numLayers + 0.5);
+  liveTime = new TH1D("liveTime", "Live Time;;Live time [s]", 1, 0, 1);
+
+  if (!eventRing_.empty()) {
+    const int depth = eventRing_.size();
+    // One orbit is 89 us, so the time axis ends at log10(89) < 2
+    interEventTime = new TH1D(
+        "interEventTime", "Time Between Events;log_{10}(#Deltat mod orbit [#mus]);Number of events", 80, -2, 2);
+    occupancyAfterHighTime = new TProfile("occupancyAfterHighTime",
+                                          "After High Charge Signal;log_{10}(#Deltat mod orbit [#mus]);Fired strips in layer",
+                                          80,
+                                          -2,
+                                          2);
+    occupancyAfterLowTime = new TProfile("occupancyAfterLowTime",
+                                         "After Low Charge Signal;log_{10}(#Deltat mod orbit [#mus]);Fired strips in layer",
+                                         80,
+                                         -2,
+                                         2);
+    occupancyAfterHighEvents = new TProfile("occupancyAfterHighEvents",
+                                            "After High Charge Signal;Triggers since;Fired strips in layer",
+                                            depth,
+                                            0.5,
+                                            depth + 0.5);
+    occupancyAfterLowEvents = new TProfile("occupancyAfterLowEvents",
+                                           "After Low Charge Signal;Triggers since;Fired strips in layer",
+                                           depth,
+                                           0.5,
+                                           depth + 0.5);
+  }
+
+  stageTicksProfile =
+      new TProfile("stageTicks", "Time per event by analysis stage;Stage;Ticks", kNumStages, -0.5, kNumStages - 0.5);
+  stageTicksProfile->GetXaxis()->SetBinLabel(kAnode + 1, "anode");
+  stageTicksProfile->GetXaxis()->SetBinLabel(kCathode + 1, "cathode");
+  stageTicksProfile->GetXaxis()->SetBinLabel(kCLCT + 1, "clct");
+  stageTicksProfile->GetXaxis()->SetBinLabel(kMatch + 1, "match");
+  stageTicksProfile->GetXaxis()->SetBinLabel(kAfterpulse + 1, "afterpulse");
+
+  for (uint16_t i = 0; i < numLayers; i++) {
+    rootHistograms_.insert(
+        rootHistograms_.end(),
+        {absADCVal[i], pedestal[i], firstPedestal[i], pulseTime[i], gainMap[i], stripRate[i], wireRate[i]});
+  }
+  rootHistograms_.insert(
+      rootHistograms_.end(),
+      {chargeTBinProfile, firedStripsADC, pulseQuality, coincidenceTimeDiff, layerRate, liveTime, stageTicksProfile});
+  if (!eventRing_.empty()) {
+    rootHistograms_.insert(rootHistograms_.end(),
+                           {interEventTime,
+                            occupancyAfterHighTime,
+                            occupancyAfterLowTime,
+                            occupancyAfterHighEvents,
+                            occupancyAfterLowEvents});
+  }
+
+  if (resume_ && !checkpointFile_.empty()) {
+    readCheckpoint();
+  }
 }
 
-// MiniCSC::~MiniCSC() {}
+// A job stopped by an exception never reaches endJob, the checkpoint writer still has to finish
+MiniCSC::~MiniCSC() {
+  if (writerThread_.joinable()) {
+    writerThread_.join();
+  }
+}
 
 // ------------ method called for each event  ------------
 void MiniCSC::analyze(const edm::Event &iEvent, const edm::EventSetup &iSetup) {
   using namespace edm;
 
+  // Already in the checkpoint. The input has to be the same as in the crashed job, the ids are only cross checked.
+  if (resumeCheck_) {
+    resumeCheck_ = false;
+    if (iEvent.id() != resumeLastId_) {
+      std::cout << "WARNING: Resumed after event " << iEvent.id() << " but the checkpoint ended at " << resumeLastId_
+                << ", check that the input and skipEvents are the same" << std::endl;
+    }
+    return;
+  }
+  lastEventId_ = iEvent.id();
+
   // Analyze Anodes
   // First we get the event by the token recieved from the python config.
   edm::Handle<CSCWireDigiCollection> wires;
   iEvent.getByToken(cscWireToken, wires);
   // Then we pass it through to our anode analyzer.
-  handleAnodes(wires);
+  uint64_t ticks[kNumStages + 1];
+  if (darkRateMode_ != kDarkRateOff) {
+    // Random trigger: every event is one readout window of live time
+    darkLiveTime_ += darkRateWindow_;
+  }
+  ticks[kAnode] = stageClock();
+  (this->*anodeHandler_)(wires);
 
   // Analyze Cathodes
   edm::Handle<CSCStripDigiCollection> strips;
   edm::Handle<CSCCLCTDigiCollection> clct;
   iEvent.getByToken(cscStripToken, strips);
   iEvent.getByToken(cscCLCTToken, clct);
-  handleCathodes(strips, clct);
+  ticks[kCathode] = stageClock();
+  (this->*cathodeHandler_)(strips);
+  ticks[kCLCT] = stageClock();
+  (this->*clctHandler_)(clct);
+  ticks[kMatch] = stageClock();
+  matchClusters();
+  ticks[kAfterpulse] = stageClock();
+  if (!eventRing_.empty()) {
+    handleAfterpulses(iEvent);
+  }
+  ticks[kNumStages] = stageClock();
+
+  // Stage i ran between timestamps i and i + 1 (the getByToken calls are counted with the stage before them)
+  for (int i = 0; i < kNumStages; i++) {
+    stageTicks[i] += ticks[i + 1] - ticks[i];
+    stageTicksProfile->Fill(i, ticks[i + 1] - ticks[i]);
+  }
 
   numEventsProc++;
+
+  if (darkRateMode_ != kDarkRateOff && numEventsProc % darkRateFlushEvents_ == 0) {
+    flushDarkRates();
+  }
+
+  // The first window runs with the mask file only, later windows add to the mask
+  if (maskWindowEvents_ > 0 && numEventsProc % maskWindowEvents_ == 0) {
+    stripMask_.update(hotChannelFactor_, deadChannelFactor_, minHotCounts_);
+    wireMask_.update(hotChannelFactor_, deadChannelFactor_, minHotCounts_);
+  }
+
+  if (!checkpointFile_.empty() && numEventsProc % checkpointEvents_ == 0) {
+    writeCheckpoint();
+  }
+  if (snapshotEvents_ > 0 && numEventsProc % snapshotEvents_ == 0) {
+    writeSnapshot();
+  }
+}
+
+bool MiniCSC::writerIdle() {
+  if (writerBusy_) {
+    return false;
+  }
+  if (writerThread_.joinable()) {
+    writerThread_.join();
+  }
+  return true;
+}
+
+// The event loop only pays for copying the histograms (a few MB), the file is written on writerThread_.
+// Not saved: the afterpulse ring and the current mask window, they start over after a resume.
+void MiniCSC::writeCheckpoint() {
+  // Never wait for the disk, a checkpoint is dropped while the previous write is still running
+  if (!writerIdle()) {
+    numCheckpointsSkipped++;
+    return;
+  }
+  if (darkRateMode_ != kDarkRateOff) {
+    flushDarkRates();
+  }
+
+  // Histogram names are unique, the checkpoint is one flat directory
+  std::vector<std::unique_ptr<TObject>> snapshot;
+  for (const TH1 *hist : rootHistograms_) {
+    TH1 *copy = static_cast<TH1 *>(hist->Clone());
+    copy->SetDirectory(nullptr);
+    snapshot.emplace_back(copy);
+  }
+  for (const CountHistogramBase *hist : countHistograms_) {
+    snapshot.emplace_back(hist->toROOT().release());
+  }
+  auto counter = [&snapshot](const std::string &name, Long64_t value) {
+    snapshot.emplace_back(new TParameter<Long64_t>(name.c_str(), value));
+  };
+  counter("numEventsProc", numEventsProc);
+  counter("numEmpty", numEmpty);
+  counter("numMaskedStrips", numMaskedStrips);
+  counter("numMaskedWires", numMaskedWires);
+  counter("numUnmappedCLCTs", numUnmappedCLCTs);
+  counter("numMatches", numMatches);
+  counter("numAmbiguousMatches", numAmbiguousMatches);
+  for (int i = 0; i < kNumStages; i++) {
+    counter("stageTicks" + std::to_string(i), stageTicks[i]);
+  }
+  counter("lastRun", lastEventId_.run());
+  counter("lastLumi", lastEventId_.luminosityBlock());
+  counter("lastEvent", lastEventId_.event());
+  snapshot.emplace_back(new TParameter<double>("darkTotalLiveTime", darkTotalLiveTime_));
+  for (uint16_t i = 0; i < numLayers; i++) {
+    const std::string layer = "L" + std::to_string(i + 1);
+    snapshot.emplace_back(new TNamed(("stripHot" + layer).c_str(), stripMask_.hot[i].to_string().c_str()));
+    snapshot.emplace_back(new TNamed(("stripDead" + layer).c_str(), stripMask_.dead[i].to_string().c_str()));
+    snapshot.emplace_back(new TNamed(("wireHot" + layer).c_str(), wireMask_.hot[i].to_string().c_str()));
+    snapshot.emplace_back(new TNamed(("wireDead" + layer).c_str(), wireMask_.dead[i].to_string().c_str()));
+    snapshot.emplace_back(
+        new TNamed(("firstPedestalSeen" + layer).c_str(), firstPedestalSeen_[i].to_string().c_str()));
+  }
+
+  writerBusy_ = true;
+  writerThread_ = std::thread([this, snapshot = std::move(snapshot)]() {
+    // Written next to the checkpoint and renamed over it, so a crash while writing keeps the previous one
+    const std::string tmpFile = checkpointFile_ + ".tmp";
+    {
+      TFile file(tmpFile.c_str(), "RECREATE", "", outputCompression_);
+      for (const auto &obj : snapshot) {
+        obj->Write();
+      }
+      file.Close();
+    }
+    if (std::rename(tmpFile.c_str(), checkpointFile_.c_str()) != 0) {
+      std::cout << "WARNING: Could not move checkpoint to " << checkpointFile_ << std::endl;
+    }
+    writerBusy_ = false;
+  });
+  numCheckpoints++;
+}
+
+// Same layout as the final output, so the usual macros can look at a run while it is still going
+void MiniCSC::writeSnapshot() {
+  if (!writerIdle()) {
+    numSnapshotsSkipped++;
+    return;
+  }
+  if (darkRateMode_ != kDarkRateOff) {
+    flushDarkRates();
+  }
+
+  std::vector<std::unique_ptr<TH1>> copies;
+  std::vector<OutputEntry> entries = outputEntries(copies);
+  // The converted histograms are already copies. Every other entry is a live histogram analyze() keeps filling (with or
+  // without a directory, cmsRun turns TH1::AddDirectory off), so the writer thread gets a clone of it.
+  std::set<const TH1 *> converted;
+  for (const auto &copy : copies) {
+    converted.insert(copy.get());
+  }
+  for (OutputEntry &entry : entries) {
+    if (!converted.count(entry.hist)) {
+      copies.emplace_back(static_cast<TH1 *>(entry.hist->Clone()));
+      copies.back()->SetDirectory(nullptr);
+      entry.hist = copies.back().get();
+    }
+  }
+
+  writerBusy_ = true;
+  writerThread_ = std::thread([this, copies = std::move(copies), entries = std::move(entries)]() {
+    const std::string tmpFile = snapshotFile_ + ".tmp";
+    {
+      TFile file(tmpFile.c_str(), "RECREATE", "", outputCompression_);
+      for (const OutputEntry &entry : entries) {
+        file.mkdir(entry.dir + 1, "", true);
+      }
+      writeOutput(&file, entries);
+      file.Close();
+    }
+    if (std::rename(tmpFile.c_str(), snapshotFile_.c_str()) != 0) {
+      std::cout << "WARNING: Could not move snapshot to " << snapshotFile_ << std::endl;
+    }
+    writerBusy_ = false;
+  });
+  numSnapshots++;
+}
+
+void MiniCSC::readCheckpoint() {
+  std::unique_ptr<TFile> file(TFile::Open(checkpointFile_.c_str(), "READ"));
+  if (!file || file->IsZombie()) {
+    std::cout << "No checkpoint in " << checkpointFile_ << ", starting from the first event" << std::endl;
+    return;
+  }
+
+  // The histograms were just booked and are empty, adding the checkpoint restores them
+  for (TH1 *hist : rootHistograms_) {
+    TH1 *saved = nullptr;
+    file->GetObject(hist->GetName(), saved);
+    if (saved) {
+      hist->Add(saved);
+    }
+  }
+  for (CountHistogramBase *hist : countHistograms_) {
+    TH1 *saved = nullptr;
+    file->GetObject(hist->GetName(), saved);
+    if (saved) {
+      hist->add(*saved);
+    }
+  }
+  auto counter = [&file](const std::string &name) -> Long64_t {
+    TParameter<Long64_t> *saved = nullptr;
+    file->GetObject(name.c_str(), saved);
+    return saved ? saved->GetVal() : 0;
+  };
+  numEventsProc = counter("numEventsProc");
+  numEmpty = counter("numEmpty");
+  numMaskedStrips = counter("numMaskedStrips");
+  numMaskedWires = counter("numMaskedWires");
+  numUnmappedCLCTs = counter("numUnmappedCLCTs");
+  numMatches = counter("numMatches");
+  numAmbiguousMatches = counter("numAmbiguousMatches");
+  for (int i = 0; i < kNumStages; i++) {
+    stageTicks[i] = counter("stageTicks" + std::to_string(i));
+  }
+  resumeLastId_ = edm::EventID(counter("lastRun"), counter("lastLumi"), counter("lastEvent"));
+  TParameter<double> *liveTime = nullptr;
+  file->GetObject("darkTotalLiveTime", liveTime);
+  darkTotalLiveTime_ = liveTime ? liveTime->GetVal() : 0.;
+  auto bits = [&file](const std::string &name, std::bitset<kMaxChannels> &out) {
+    TNamed *saved = nullptr;
+    file->GetObject(name.c_str(), saved);
+    if (saved) {
+      out = std::bitset<kMaxChannels>(std::string(saved->GetTitle()));
+    }
+  };
+  for (uint16_t i = 0; i < numLayers; i++) {
+    const std::string layer = "L" + std::to_string(i + 1);
+    bits("stripHot" + layer, stripMask_.hot[i]);
+    bits("stripDead" + layer, stripMask_.dead[i]);
+    bits("wireHot" + layer, wireMask_.hot[i]);
+    bits("wireDead" + layer, wireMask_.dead[i]);
+    bits("firstPedestalSeen" + layer, firstPedestalSeen_[i]);
+    stripMask_.masked[i] = stripMask_.hot[i] | stripMask_.dead[i];
+    wireMask_.masked[i] = wireMask_.hot[i] | wireMask_.dead[i];
+  }
+  file->Close();
+  fout->cd();
+
+  resumeCheck_ = numEventsProc > 0;
+  std::cout << "Resuming from " << checkpointFile_ << " after " << numEventsProc << " events, up to " << resumeLastId_
+            << std::endl;
+}
+
+void MiniCSC::flushDarkRates() {
+  if (darkLiveTime_ <= 0.) {
+    return;
+  }
+  for (uint16_t i = 0; i < numLayers; i++) {
+    uint64_t layerHits = 0;
+    for (int ch = stripLow + 0.5; ch < stripHigh && ch < kMaxChannels; ch++) {
+      stripRate[i]->Fill(ch, darkStripHits_[i][ch] / (darkLiveTime_ * stripArea_), darkLiveTime_);
+    }
+    for (int ch = wiregroupLow + 0.5; ch < wiregroupHigh && ch < kMaxChannels; ch++) {
+      wireRate[i]->Fill(ch, darkWireHits_[i][ch] / (darkLiveTime_ * wiregroupArea_), darkLiveTime_);
+    }
+    for (int ch = 0; ch < kMaxChannels; ch++) {
+      layerHits += darkWireHits_[i][ch];
+    }
+    layerRate->Fill(i + 1, layerHits / (darkLiveTime_ * layerArea_), darkLiveTime_);
+  }
+  liveTime->Fill(0.5, darkLiveTime_);
+  darkTotalLiveTime_ += darkLiveTime_;
+  darkLiveTime_ = 0.;
+  memset(darkStripHits_, 0, sizeof(darkStripHits_));
+  memset(darkWireHits_, 0, sizeof(darkWireHits_));
+}
+
+void MiniCSC::ChannelMask::update(double hotFactor, double deadFactor, uint32_t minHotCounts) {
+  for (uint16_t layer = 0; layer < numLayers; layer++) {
+    const uint32_t *c = counts[layer];
+    // Only channels between the first and last one that fired, the rest are not read out on a miniCSC
+    int first = 0, last = kMaxChannels - 1;
+    while (first < kMaxChannels && c[first] == 0) {
+      first++;
+    }
+    while (last > first && c[last] == 0) {
+      last--;
+    }
+    if (first == kMaxChannels) {
+      continue;
+    }
+
+    std::vector<uint32_t> occupancy(c + first, c + last + 1);
+    std::nth_element(occupancy.begin(), occupancy.begin() + occupancy.size() / 2, occupancy.end());
+    const double median = occupancy[occupancy.size() / 2];
+
+    for (int ch = first; ch <= last && median > 0; ch++) {
+      if (masked[layer][ch]) {
+        continue;
+      }
+      if (c[ch] >= minHotCounts && c[ch] > hotFactor * median) {
+        hot[layer].set(ch);
+      } else if (c[ch] < deadFactor * median) {
+        dead[layer].set(ch);
+      }
+    }
+    masked[layer] = hot[layer] | dead[layer];
+    std::fill(counts[layer], counts[layer] + kMaxChannels, 0);
+  }
+}
+
+// Mask file, one channel per line: <strip|wire> <layer 1-6> <channel> <hot|dead>
+void MiniCSC::readChannelMask(const std::string &fileName) {
+  const int numRead = minicscsignal::readChannelMaskFile(
+      fileName, numLayers, kMaxChannels, [this](bool isStrip, int layer, int channel, bool isHot) {
+        ChannelMask &mask = isStrip ? stripMask_ : wireMask_;
+        (isHot ? mask.hot : mask.dead)[layer].set(channel);
+        mask.masked[layer].set(channel);
+      });
+  if (numRead < 0) {
+    std::cout << "Channel mask file " << fileName << " not found, starting without a mask" << std::endl;
+    return;
+  }
+  std::cout << "Channel mask: " << numRead << " channels from " << fileName << std::endl;
+}
+
+void MiniCSC::writeChannelMask(const std::string &fileName) const {
+  std::ofstream out(fileName);
+  out << "# MiniCSC channel mask: <strip|wire> <layer 1-6> <channel> <hot|dead>\n";
+  for (const auto &type : {std::make_pair("strip", &stripMask_), std::make_pair("wire", &wireMask_)}) {
+    for (uint16_t layer = 0; layer < numLayers; layer++) {
+      for (int ch = 0; ch < kMaxChannels; ch++) {
+        if (type.second->masked[layer][ch]) {
+          out << type.first << " " << layer + 1 << " " << ch << " " << (type.second->hot[layer][ch] ? "hot" : "dead")
+              << "\n";
+        }
+      }
+    }
+  }
+  if (!out) {
+    std::cout << "Could not write channel mask file " << fileName << std::endl;
+  }
 }
 
 // Contains some commented out code that was originally used for debug purposes. I'm leaving it for future reference if someone needs to do similar debugging.
+template <class Geometry>
 void MiniCSC::handleAnodes(const edm::Handle<CSCWireDigiCollection> wires) {
+  for (auto &clusters : anodeClusters_) {
+    clusters.clear();
+  }
+
   // Check for empty collection
   if (wires->begin() == wires->end()) {
     numEmpty++;
@@ -312,6 +1181,13 @@ void MiniCSC::handleAnodes(const edm::Handle<CSCWireDigiCollection> wires) {
 
     // Iterate through all wiregroups
     while (wireIt != lastWire) {
+      // Masked wiregroups are dropped before anything is filled
+      if (wireMask_.test(currLayer, wireIt->getWireGroup())) {
+        numMaskedWires++;
+        ++wireIt;
+        continue;
+      }
+
       // std::cout << "\t" << wireIt->getWireGroup() << "\t" << wireIt->getTimeBin() << std::endl;
       // station_ring[0]->Fill(endcap * id.station(), id.ring());  //get station and ring
 
@@ -326,6 +1202,7 @@ void MiniCSC::handleAnodes(const edm::Handle<CSCWireDigiCollection> wires) {
       bool nextWG = true;  // check for consecutive WG
 
       const int currentWGN = wireIt->getWireGroup();
+      const int currentBX = wireIt->getTimeBin();
 
       // looking for consecutive hits
       std::vector<CSCWireDigi>::const_iterator nwgIt = wireIt + 1;
@@ -333,9 +1210,16 @@ void MiniCSC::handleAnodes(const edm::Handle<CSCWireDigiCollection> wires) {
         nWGh++;
 
         const int WGN = wireIt->getWireGroup();
+        // Every wiregroup of the cluster counts towards the mask monitor and the dark rates, as every strip does
+        if (maskWindowEvents_ > 0) {
+          wireMask_.count(currLayer, WGN);
+        }
+        if (darkRateMode_ != kDarkRateOff && WGN <= Geometry::kNumWiregroups) {
+          darkWireHits_[currLayer][WGN]++;
+        }
 
         if (nwgIt != lastWire) {
-          nextWG = ((nwgIt->getWireGroup() - WGN) == 1);
+          nextWG = ((nwgIt->getWireGroup() - WGN) == 1) && !wireMask_.test(currLayer, nwgIt->getWireGroup());
           ++nwgIt;
         } else {
           nextWG = false;
@@ -344,68 +1228,74 @@ void MiniCSC::handleAnodes(const edm::Handle<CSCWireDigiCollection> wires) {
       }  // end checking consecutive hits
       firedWireGroups->Fill(nWGh);
       h2dNofAhitWG[currLayer]->Fill(currentWGN, nWGh);
+      anodeClusters_[currLayer].push_back(HitCluster{currentWGN + (nWGh - 1) / 2.f, 0.f, currentBX});
 
     };  // all wires
   }     // all layers for wires
 }
 
-void MiniCSC::handleCathodes(const edm::Handle<CSCStripDigiCollection> strips,
-                             const edm::Handle<CSCCLCTDigiCollection> clct) {
+template <class Geometry>
+void MiniCSC::handleCathodes(const edm::Handle<CSCStripDigiCollection> strips) {
+  for (auto &clusters : cathodeClusters_) {
+    clusters.clear();
+  }
+  std::fill(firedStripsInLayer_, firedStripsInLayer_ + numLayers, 0);
+
   // All layers for strips
   for (CSCStripDigiCollection::DigiRangeIterator si = strips->begin(); si != strips->end(); si++) {
     CSCDetId id = (CSCDetId)(*si).first;
-    std::vector<CSCStripDigi>::const_iterator stripIt = (*si).second.first;
-    std::vector<CSCStripDigi>::const_iterator lastStrip = (*si).second.second;
 
     const uint16_t currLayer = id.layer() - 1;
+    // NOTE: The ring 4 offset is copied from other CSC code. This does not really change the output other than
+    // shift graphs over.
+    const int stripOffset = Geometry::stripOffset(id.ring());
 
     // Total charge per strip in layer
     std::vector<float> chgPerStrip;
 
-    // Each strip in layer
-    while (stripIt != lastStrip) {
-      uint16_t nStriph = 0;   // number of consecutive Strips found
-      bool nextStrip = true;  // check for consecutive Strip
-
-      // looking for consecutive hits
-      std::vector<CSCStripDigi>::const_iterator nStripIt = stripIt + 1;
-      bool was_signal = false;
-      while (nextStrip) {
-        // getADCCounts() returns a vector containing the adc value for each time bin. The position in the vector is equal to the time bin.
-        // Here is an example, I used made up numbers however the general shape should be similar (bell curve ish):
-        // Time Bin    0    1    2    3    4    5    6    7
-        // ADC Value 1023 1025 1126 1354 1232 1158 1089 1025
-        std::vector<int> ADCVals = stripIt->getADCCounts();
-        int strNum = stripIt->getStrip();  // 1->16
-
-        // NOTE: This is copied from other CSC code. This does not really change the output other than shift graphs over.
-        if (id.ring() == 4) {
-          strNum = strNum + 64;
-        }
-
-        // Get pedestal. The pedestal is the "zero" for the ADC, ideally this is 1024 however due to noise this may fluctuate.
-        // Any time bin above this pedestal are considered valid signals.
-        // The pedestal is commonly (including the line below) implemented as (TBin0 + TBin1) / 2.
-        const float ped = stripIt->pedestal();
-        // Fill pedestal graphs
-        avgPedestals[currLayer]->Fill(strNum, ped);
-        if (fstPedestal[currLayer]->GetBinContent(strNum) == 0) {
-          fstPedestal[currLayer]->Fill(strNum, ped);
-        }
+    uint16_t nStriph = 0;  // number of consecutive Strips found
+    // Cluster sums for the anode-cathode matching, the cluster time is the one of its highest strip
+    float clusterCharge = 0.f, clusterMoment = 0.f, clusterPeak = 0.f;
+    int clusterBX = 0;
+
+    // Same clusters as the skim filter, masked strips are dropped before their ADC counts are copied
+    minicscsignal::walkStripClusters(
+        (*si).second.first,
+        (*si).second.second,
+        [&](const CSCStripDigi &digi) { return stripMask_.test(currLayer, digi.getStrip() + stripOffset); },
+        [&](const CSCStripDigi &) { numMaskedStrips++; },
+        [&](const CSCStripDigi &digi) {
+          // getADCCounts() returns a vector containing the adc value for each time bin. The position in the vector is equal to the time bin.
+          // Here is an example, I used made up numbers however the general shape should be similar (bell curve ish):
+          // Time Bin    0    1    2    3    4    5    6    7
+          // ADC Value 1023 1025 1126 1354 1232 1158 1089 1025
+          std::vector<int> ADCVals = digi.getADCCounts();
+          const int strNum = digi.getStrip() + stripOffset;
+
+          // Get pedestal. The pedestal is the "zero" for the ADC, ideally this is 1024 however due to noise this may fluctuate.
+          // Any time bin above this pedestal are considered valid signals.
+          // The pedestal is commonly (including the line below) implemented as (TBin0 + TBin1) / 2.
+          const float ped = digi.pedestal();
+          // Fill pedestal graphs
+          pedestal[currLayer]->Fill(strNum, ped);
+          if (strNum <= Geometry::kNumStrips && !firstPedestalSeen_[currLayer][strNum]) {
+            firstPedestalSeen_[currLayer].set(strNum);
+            firstPedestal[currLayer]->Fill(strNum, ped);
+          }
 
-        // Determines if the strip has fired by checking if any time bin is <adcThres_> ADC greater than the pedestal
-        was_signal = false;
-        for (size_t k = 0; k < ADCVals.size(); k++) {
-          if ((ADCVals[k] - ped) > adcThres_) {
-            was_signal = true;
-            break;
+          // Determines if the strip has fired by checking if any time bin is <adcThres_> ADC greater than the pedestal
+          const bool was_signal = minicscsignal::hasSignal(ADCVals, ped, adcThres_);
+          if (!was_signal) {
+            return false;
           }
-        }
 
-        if (was_signal) {
           nStriph++;
           // Total charge from all time bins for strip
           float sumChargesStrip = 0.0f;
+          // Pedestal subtracted samples for the pulse fit
+          float samples[CSCPulseTemplate::kNumTimeBins] = {};
+          // Highest time bin, the strip time when there is no pulse fit
+          size_t peakBin = 0;
 
           // Iterate through all time bins
           for (size_t i = 0; i < ADCVals.size(); i++) {
@@ -425,25 +1315,55 @@ void MiniCSC::handleCathodes(const edm::Handle<CSCStripDigiCollection> strips,
             //   sumChargesStrip += charge;
             // }
             sumChargesStrip += charge;
+            if (i < CSCPulseTemplate::kNumTimeBins) {
+              samples[i] = charge;
+            }
+            if (ADCVals[i] > ADCVals[peakBin]) {
+              peakBin = i;
+            }
+          }
+          float stripTime = peakBin * CSCPulseTemplate::kBinWidth;
+
+          // Amplitude and peak time from the shaper template. Its charge leaves out the pedestal noise of the sum.
+          if (ADCVals.size() >= CSCPulseTemplate::kNumTimeBins) {
+            const CSCPulseTemplate::Result pulse = pulseTemplate_.fit(samples);
+            pulseTime[currLayer]->Fill(pulse.peakTime);
+            pulseQuality->Fill(pulse.quality);
+            if (templateCharge_) {
+              sumChargesStrip = pulse.charge;
+            }
+            stripTime = pulse.peakTime;
           }
           // Add strip charge to collection
           chgPerStrip.push_back(sumChargesStrip);
+          clusterCharge += sumChargesStrip;
+          clusterMoment += sumChargesStrip * strNum;
+          if (sumChargesStrip > clusterPeak) {
+            clusterPeak = sumChargesStrip;
+            clusterBX = std::lround(stripTime / kBunchSpacing);
+          }
 
           // Fill strip occupancy
           strip[currLayer]->Fill(strNum);
-
-        }  // was signal
-        // Logic to continue checking consecutive strips
-        if (nStripIt != lastStrip) {
-          nextStrip = was_signal;
-          ++nStripIt;
-        } else {
-          nextStrip = false;
-        }
-        ++stripIt;
-      }  // End consecutive strips
-      firedStrips->Fill(nStriph);
-    }  // all strips
+          firedStripsInLayer_[currLayer]++;
+          if (maskWindowEvents_ > 0) {
+            stripMask_.count(currLayer, strNum);
+          }
+          if (darkRateMode_ != kDarkRateOff && strNum <= Geometry::kNumStrips) {
+            darkStripHits_[currLayer][strNum]++;
+          }
+          return true;
+        },
+        [&]() {
+          firedStrips->Fill(nStriph);
+          if (clusterCharge > 0.f) {
+            cathodeClusters_[currLayer].push_back(
+                HitCluster{clusterMoment / clusterCharge, clusterCharge, clusterBX});
+          }
+          nStriph = 0;
+          clusterCharge = clusterMoment = clusterPeak = 0.f;
+          clusterBX = 0;
+        });
 
     float sumCharges = 0.0f;
     int width = 0;
@@ -460,7 +1380,10 @@ void MiniCSC::handleCathodes(const edm::Handle<CSCStripDigiCollection> strips,
       firedStripsADC->Fill(width, sumCharges);
     }
   }  // strip collection
+}
 
+template <class Geometry>
+void MiniCSC::handleCLCTs(const edm::Handle<CSCCLCTDigiCollection> clct) {
   // Halfstrips
   for (CSCCLCTDigiCollection::DigiRangeIterator ci = clct->begin(); ci != clct->end(); ci++) {
     CSCDetId id = (CSCDetId)(*ci).first;
@@ -468,102 +1391,354 @@ void MiniCSC::handleCathodes(const edm::Handle<CSCStripDigiCollection> strips,
     std::vector<CSCCLCTDigi>::const_iterator lastCLCT = (*ci).second.second;
 
     for (; clctIt != lastCLCT; ++clctIt) {
-      short unsigned int cfebId = clctIt->getCFEB();
-      // HACK: cfebId - 2 makes things line up with correct strip layers, unsure of edge cases
-      float hstrNum = clctIt->getKeyStrip();
-      if (id.ring() == 4) {
-        hstrNum += 128;
+      const uint16_t cfebId = clctIt->getCFEB();
+      const int layer = cfebId < kNumCFEBSlots ? cfebLayer_[cfebId] : -1;
+      if (layer < 0) {
+        numUnmappedCLCTs++;
+        continue;
       }
-      halfStrip[cfebId - 2]->Fill(hstrNum);
+      const float hstrNum = clctIt->getKeyStrip() + Geometry::halfStripOffset(id.ring());
+      halfStrip[layer]->Fill(hstrNum);
+      clctPattern[layer]->Fill(clctIt->getPattern());
+      clctBend[layer]->Fill(clctIt->getBend());
     }  // All clct
   }    // clct collection
 }
 
-// ------------ method called once each job just after ending the event loop
-// ------------
-void MiniCSC::endJob() {
-  std::cout << "Events Processed: " << numEventsProc << std::endl;
-  std::cout << "Num events spectra: " << charges[2]->GetEntries() << std::endl;
-  std::cout << "Number of empty wire collections: " << numEmpty << std::endl;
-  std::cout << "Writing to root file" << std::endl;
+// Bucketed by anode time bin instead of sorted, so matching is linear in the number of clusters
+void MiniCSC::matchClusters() {
+  const int window = coincidenceWindowBX_;
+  for (uint16_t layer = 0; layer < numLayers; layer++) {
+    const std::vector<HitCluster> &anodes = anodeClusters_[layer];
+    const std::vector<HitCluster> &cathodes = cathodeClusters_[layer];
+    if (anodes.empty() || cathodes.empty()) {
+      continue;
+    }
+    if (anodes.size() == 1 && cathodes.size() == 1) {
+      coincidenceTimeDiff->Fill(anodes[0].bx - cathodes[0].bx);
+    }
 
-  // Normalize avgPedestals
-  for (uint16_t i = 0; i < numLayers; i++) {
-    // NOTE: 120 is number of xbins
-    for (uint16_t j = 0; j < 120; j++) {
-      avgPedestals[i]->SetBinContent(j, avgPedestals[i]->GetBinContent(j) / numEventsProc);
-      avgPedestals[i]->SetBinError(j, avgPedestals[i]->GetBinError(j) / numEventsProc);
-      if (fstPedestal[i]->GetBinContent(j) != 0) {
-        fstPedestal[i]->SetBinError(j, 1024 - fstPedestal[i]->GetBinContent(j));
+    std::fill(bucketHead_, bucketHead_ + kNumAnodeTimeBins, -1);
+    bucketNext_.resize(anodes.size());
+    for (size_t i = 0; i < anodes.size(); i++) {
+      const int bx = std::clamp<int>(anodes[i].bx, 0, kNumAnodeTimeBins - 1);
+      bucketNext_[i] = bucketHead_[bx];
+      bucketHead_[bx] = i;
+    }
+
+    // Each cathode cluster takes the anode cluster closest in time, inside the window. Two anode clusters in that
+    // time bin cannot be told apart, those cathode clusters are left out of the map.
+    for (const HitCluster &cathode : cathodes) {
+      const int bx = cathode.bx + cathodeTimeOffsetBX_;
+      int best = -1, bestDiff = window + 1;
+      for (int b = std::max(0, bx - window); b <= std::min<int>(kNumAnodeTimeBins - 1, bx + window); b++) {
+        if (bucketHead_[b] >= 0 && std::abs(b - bx) < bestDiff) {
+          best = bucketHead_[b];
+          bestDiff = std::abs(b - bx);
+        }
       }
+      if (best < 0) {
+        continue;
+      }
+      if (bucketNext_[best] >= 0) {
+        numAmbiguousMatches++;
+        continue;
+      }
+      gainMap[layer]->Fill(cathode.position, anodes[best].position, cathode.charge);
+      numMatches++;
     }
   }
+}
 
-  fout->cd();
+// Fixed size ring, so memory does not grow with the run and steady state events do not allocate
+void MiniCSC::handleAfterpulses(const edm::Event &iEvent) {
+  // EmptySource makes up the orbit and bunch crossing of the event, the real ones are in the CDF header the DDU
+  // (or DCC) puts in front of its data. Every CSC FED of an event carries the same L1A/BXN, the first one will do.
+  edm::Handle<FEDRawDataCollection> rawData;
+  iEvent.getByToken(rawDataToken, rawData);
+  const FEDRawData *fedData = nullptr;
+  for (int id = FEDNumbering::MINCSCDDUFEDID; id <= FEDNumbering::MAXCSCDDUFEDID && !fedData; id++) {
+    fedData = rawData->FEDData(id).size() >= 32 ? &rawData->FEDData(id) : nullptr;
+  }
+  for (int id = FEDNumbering::MINCSCFEDID; id <= FEDNumbering::MAXCSCFEDID && !fedData; id++) {
+    fedData = rawData->FEDData(id).size() >= 32 ? &rawData->FEDData(id) : nullptr;
+  }
+  if (!fedData) {
+    return;
+  }
+  const FEDHeader header(fedData->data());
+  if (!header.check()) {
+    return;
+  }
+
+  EventSummary current;
+  current.l1a = header.lvl1ID();
+  current.bxn = header.bxID();
+  for (uint16_t layer = 0; layer < numLayers; layer++) {
+    current.firedStrips[layer] = firedStripsInLayer_[layer];
+    current.maxClusterCharge[layer] = 0.f;
+    for (const HitCluster &cluster : cathodeClusters_[layer]) {
+      current.maxClusterCharge[layer] = std::max(current.maxClusterCharge[layer], cluster.charge);
+    }
+  }
+
+  // Newest first, k events back. The L1A difference counts the triggers in between, including the ones a filter
+  // dropped. The BXN difference is only the time modulo one orbit (3564 BX, 89 us): it is exact for events less
+  // than an orbit apart and aliased beyond that, so a BXN difference of 0 has no time.
+  for (size_t k = 1; k <= ringSize_; k++) {
+    const EventSummary &earlier = eventRing_[(ringHead_ + eventRing_.size() - k) % eventRing_.size()];
+    const uint32_t triggers = (current.l1a - earlier.l1a) & 0xFFFFFF;
+    const int bxDiff = (current.bxn - earlier.bxn + kBXPerOrbit) % kBXPerOrbit;
+    const bool hasTime = bxDiff > 0;
+    const double logTime = hasTime ? std::log10(bxDiff * kBunchSpacing * 1e-3) : 0.;
+    if (k == 1 && hasTime) {
+      interEventTime->Fill(logTime);
+    }
+    for (uint16_t layer = 0; layer < numLayers; layer++) {
+      if (earlier.maxClusterCharge[layer] <= 0.f) {
+        continue;
+      }
+      const bool high = earlier.maxClusterCharge[layer] > afterpulseChargeThreshold_;
+      (high ? occupancyAfterHighEvents : occupancyAfterLowEvents)->Fill(triggers, current.firedStrips[layer]);
+      if (hasTime) {
+        (high ? occupancyAfterHighTime : occupancyAfterLowTime)->Fill(logTime, current.firedStrips[layer]);
+      }
+    }
+  }
+
+  eventRing_[ringHead_] = current;
+  ringHead_ = (ringHead_ + 1) % eventRing_.size();
+  ringSize_ = std::min(ringSize_ + 1, eventRing_.size());
+}
 
-  // Write Anode histograms
+std::vector<MiniCSC::OutputEntry> MiniCSC::outputEntries(std::vector<std::unique_ptr<TH1>> &owned) const {
+  std::vector<OutputEntry> entries;
+  auto convert = [&owned](const CountHistogramBase *hist) {
+    owned.push_back(hist->toROOT());
+    return owned.back().get();
+  };
+
+  // Anode histograms
   for (uint16_t i = 0; i < numLayers; i++) {
     if (wire[i]->GetEntries() != 0) {
-      fout->cd("/Anode/wire/");
-      wire[i]->Write();
+      entries.push_back({"/Anode/wire/", convert(wire[i])});
     }
     if (h2dNofAhitWG[i]->GetEntries() != 0) {
-      fout->cd("/Anode/simulAnodeHit/");
-      h2dNofAhitWG[i]->Write();
+      entries.push_back({"/Anode/simulAnodeHit/", convert(h2dNofAhitWG[i])});
     }
     if (anodeFiredTimeBins[i]->GetEntries() != 0) {
-      fout->cd("/Anode/firedTBinAnode/");
-      anodeFiredTimeBins[i]->Write();
+      entries.push_back({"/Anode/firedTBinAnode/", convert(anodeFiredTimeBins[i])});
     }
   }
-  fout->cd("/Anode/");
-  firedWireGroups->Write();
+  entries.push_back({"/Anode/", convert(firedWireGroups)});
 
-  // Write Cathode histograms
-  fout->cd("/Cathode/");
+  // Cathode histograms
   for (uint16_t i = 0; i < numLayers; i++) {
-    // Plot everything relating to strip occupancy
+    // Everything relating to strip occupancy
     if (strip[i]->GetEntries() != 0) {
-      fout->cd("/Cathode/strip/");
-      strip[i]->Write();
-      fout->cd("/Cathode/halfStrip/");
-      halfStrip[i]->Write();
+      entries.push_back({"/Cathode/strip/", convert(strip[i])});
+      entries.push_back({"/Cathode/halfStrip/", convert(halfStrip[i])});
     }
 
-    // Plot everything related to charge spectra
+    // Everything related to charge spectra
     if (charges[i]->GetEntries() != 0) {
-      fout->cd("/Cathode/charge/");
-      charges[i]->Write();
-      fout->cd("/Cathode/stripTBinADCVal/");
-      absADCVal[i]->Write();
-      fout->cd("/Cathode/avgPedestal/");
-      avgPedestals[i]->Write();
-      fout->cd("/Cathode/fstPedestal/");
-      fstPedestal[i]->Write();
-    }
-  }
-  fout->cd("/Cathode/");
-  firedStrips->Write();
-  firedStripsADC->Write();
-  chargeTBinProfile->Write();
+      TH1 *charge = convert(charges[i]);
+      entries.push_back({"/Cathode/charge/", charge});
+      // Same spectrum at coarser binnings, names stay unique across directories for the parallel writer
+      for (size_t l = 0; l < chargePyramidLevels_.size(); l++) {
+        const std::string name = "chargeRebin" + std::to_string(chargePyramidLevels_[l]) + "L" + std::to_string(i + 1);
+        owned.emplace_back(charge->Rebin(chargePyramidLevels_[l], name.c_str()));
+        owned.back()->SetDirectory(nullptr);
+        entries.push_back({chargePyramidDirs_[l].c_str(), owned.back().get()});
+      }
+      entries.push_back({"/Cathode/stripTBinADCVal/", absADCVal[i]});
+      entries.push_back({"/Cathode/pedestal/", pedestal[i]});
+      entries.push_back({"/Cathode/firstPedestal/", firstPedestal[i]});
+      entries.push_back({"/Cathode/pulseTime/", pulseTime[i]});
+    }
+  }
+  entries.push_back({"/Cathode/", convert(firedStrips)});
+  entries.push_back({"/Cathode/", firedStripsADC});
+  entries.push_back({"/Cathode/", chargeTBinProfile});
+  entries.push_back({"/Cathode/", pulseQuality});
+
+  for (uint16_t i = 0; i < numLayers; i++) {
+    if (clctPattern[i]->GetEntries() != 0) {
+      entries.push_back({"/CLCT/pattern/", convert(clctPattern[i])});
+      entries.push_back({"/CLCT/bend/", convert(clctBend[i])});
+    }
+  }
+
+  for (uint16_t i = 0; i < numLayers; i++) {
+    if (gainMap[i]->GetEntries() != 0) {
+      entries.push_back({"/Coincidence/gainMap/", gainMap[i]});
+    }
+  }
+  entries.push_back({"/Coincidence/", coincidenceTimeDiff});
+
+  if (darkRateMode_ != kDarkRateOff) {
+    for (uint16_t i = 0; i < numLayers; i++) {
+      entries.push_back({"/DarkRate/stripRate/", stripRate[i]});
+      entries.push_back({"/DarkRate/wireRate/", wireRate[i]});
+    }
+    entries.push_back({"/DarkRate/", layerRate});
+    entries.push_back({"/DarkRate/", liveTime});
+  }
+
+  if (!eventRing_.empty()) {
+    entries.push_back({"/Afterpulse/", interEventTime});
+    entries.push_back({"/Afterpulse/", occupancyAfterHighTime});
+    entries.push_back({"/Afterpulse/", occupancyAfterLowTime});
+    entries.push_back({"/Afterpulse/", occupancyAfterHighEvents});
+    entries.push_back({"/Afterpulse/", occupancyAfterLowEvents});
+  }
+
+  entries.push_back({"/Timing/", stageTicksProfile});
+
+  // Channel mask, 1 = hot and 2 = dead, so the output records which channels were left out
+  char t1[250], t2[250];
+  for (uint16_t i = 0; i < numLayers; i++) {
+    for (const auto &type : {std::make_pair("strip", &stripMask_), std::make_pair("wire", &wireMask_)}) {
+      sprintf(t1, "%sMaskL%d", type.first, i + 1);
+      sprintf(t2, "Masked %ss for Layer = %d (1 = hot, 2 = dead);Channel;Flag", type.first, i + 1);
+      owned.emplace_back(new TH1I(t1, t2, kMaxChannels, -0.5, kMaxChannels - 0.5));
+      owned.back()->SetDirectory(nullptr);
+      for (int ch = 0; ch < kMaxChannels; ch++) {
+        if (type.second->masked[i][ch]) {
+          owned.back()->SetBinContent(ch + 1, type.second->hot[i][ch] ? 1 : 2);
+        }
+      }
+      entries.push_back({"/Mask/", owned.back().get()});
+    }
+  }
+  return entries;
+}
+
+// Streaming and compressing the histograms is where the time goes, at high compression levels by far. With more than
+// one thread every thread writes a share of the histograms into its own TMemFile, then the already compressed keys are
+// copied into the file in the original order, so the layout does not depend on the number of threads.
+void MiniCSC::writeOutput(TFile *file, const std::vector<OutputEntry> &entries) const {
+  const size_t numThreads = std::min<size_t>(outputThreads_, entries.size());
+  if (numThreads <= 1) {
+    for (const OutputEntry &entry : entries) {
+      file->cd(entry.dir);
+      entry.hist->Write();
+    }
+    return;
+  }
+
+  std::vector<std::unique_ptr<TMemFile>> shares(numThreads);
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < numThreads; t++) {
+    workers.emplace_back([&entries, &shares, file, numThreads, t]() {
+      shares[t] = std::make_unique<TMemFile>(
+          ("MiniCSCOutput" + std::to_string(t)).c_str(), "RECREATE", "", file->GetCompressionSettings());
+      for (size_t i = t; i < entries.size(); i += numThreads) {
+        shares[t]->WriteTObject(entries[i].hist);
+      }
+    });
+  }
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+
+  for (size_t i = 0; i < entries.size(); i++) {
+    TKey *key = shares[i % numThreads]->GetKey(entries[i].hist->GetName());
+    if (!key) {
+      throw cms::Exception("FileWriteError") << "MiniCSC: " << entries[i].hist->GetName() << " was not serialized";
+    }
+    file->cd(entries[i].dir);
+    // Copies the compressed record as it is, the new key belongs to the directory
+    TKey *copy = new TKey(gDirectory, *key, 0);
+    copy->WriteFile(0);
+  }
+  // The copied keys only hold the objects, the StreamerInfos describing them went into the shares. Tagging every
+  // class written (its bases and members come along) puts the same records into the StreamerInfo of file.
+  std::set<TClass *> classes;
+  for (const OutputEntry &entry : entries) {
+    classes.insert(entry.hist->IsA());
+  }
+  for (TClass *cls : classes) {
+    cls->GetStreamerInfo()->ForceWriteInfo(file, true);
+  }
+  file->cd();
+}
+
+// ------------ method called once each job just after ending the event loop
+// ------------
+void MiniCSC::endJob() {
+  if (writerThread_.joinable()) {
+    writerThread_.join();
+  }
+  if (darkRateMode_ != kDarkRateOff) {
+    flushDarkRates();
+  }
+  std::cout << "Events Processed: " << numEventsProc << std::endl;
+  std::cout << "Num events spectra: " << charges[2]->GetEntries() << std::endl;
+  std::cout << "Number of empty wire collections: " << numEmpty << std::endl;
+  std::cout << "Masked strip digis: " << numMaskedStrips << ", masked wire digis: " << numMaskedWires << std::endl;
+  std::cout << "CLCTs on unmapped CFEBs: " << numUnmappedCLCTs << std::endl;
+  std::cout << "Matched cathode clusters: " << numMatches << ", ambiguous: " << numAmbiguousMatches << std::endl;
+  if (darkRateMode_ != kDarkRateOff) {
+    std::cout << "Dark rate live time [s]: " << darkTotalLiveTime_ << std::endl;
+  }
+  if (!checkpointFile_.empty()) {
+    std::cout << "Checkpoints written: " << numCheckpoints << ", skipped while busy: " << numCheckpointsSkipped
+              << std::endl;
+  }
+  if (snapshotEvents_ > 0) {
+    std::cout << "Snapshots written: " << numSnapshots << ", skipped while busy: " << numSnapshotsSkipped
+              << std::endl;
+  }
+  for (int i = 0; i < kNumStages; i++) {
+    std::cout << "Average ticks per event, " << stageTicksProfile->GetXaxis()->GetBinLabel(i + 1) << ": "
+              << (numEventsProc ? stageTicks[i] / numEventsProc : 0) << std::endl;
+  }
+  std::cout << "Writing to root file" << std::endl;
+
+  // Nothing is normalized here, every histogram is written as an accumulator so outputs can be merged
+  const auto writeStart = std::chrono::steady_clock::now();
+  std::vector<std::unique_ptr<TH1>> converted;
+  writeOutput(fout, outputEntries(converted));
   fout->Close();
+  std::cout << "Output written in "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - writeStart)
+                   .count()
+            << " ms on " << outputThreads_ << " thread(s)" << std::endl;
+  if (!channelMaskOutputFile_.empty()) {
+    writeChannelMask(channelMaskOutputFile_);
+  }
 
   // Delete all histograms
 
   for (uint16_t i = 0; i < numLayers; i++) {
-    wire[i]->Delete();
-    h2dNofAhitWG[i]->Delete();
-    anodeFiredTimeBins[i]->Delete();
-
-    charges[i]->Delete();
     absADCVal[i]->Delete();
-    avgPedestals[i]->Delete();
-    fstPedestal[i]->Delete();
+    pedestal[i]->Delete();
+    firstPedestal[i]->Delete();
+    pulseTime[i]->Delete();
+    gainMap[i]->Delete();
+    stripRate[i]->Delete();
+    wireRate[i]->Delete();
   }
-  firedWireGroups->Delete();
-  firedStrips->Delete();
+  for (CountHistogramBase *hist : countHistograms_) {
+    delete hist;
+  }
+  countHistograms_.clear();
   chargeTBinProfile->Delete();
   firedStripsADC->Delete();
+  pulseQuality->Delete();
+  coincidenceTimeDiff->Delete();
+  layerRate->Delete();
+  liveTime->Delete();
+  if (!eventRing_.empty()) {
+    interEventTime->Delete();
+    occupancyAfterHighTime->Delete();
+    occupancyAfterLowTime->Delete();
+    occupancyAfterHighEvents->Delete();
+    occupancyAfterLowEvents->Delete();
+  }
+  stageTicksProfile->Delete();
+  rootHistograms_.clear();
 }
 
 /*
@@ -0,0 +1,184 @@
+// -*- C++ -*-
+//
+// Package:    MiniCSC/MiniCSC
+// Class:      MiniCSCPrefetchRawReader
+//
+/**\class MiniCSCPrefetchRawReader MiniCSCPrefetchRawReader.cc MiniCSC/MiniCSC/plugins/MiniCSCPrefetchRawReader.cc
+
+ Description: Drop-in replacement for CSCFileReader that reads the RUI files ahead on background threads
+
+ Implementation:
+     Configured like CSCFileReader: FEDnnn = list of RUIs whose events go into that FED, RUInn = list of files.
+     Every RUI gets its own RUIPrefetcher (and thread), so FED838 and FED839 files are read at the same time and the
+     event loop only waits when the disk really cannot keep up. Each event is copied once, from the prefetch buffer
+     into the FEDRawData, since the event product has to own its data.
+     A RUI whose files are .mcsa archives (see bin/miniCSCArchive.cc) is read through minicscarchive::Reader instead,
+     which decompresses several blocks in parallel and uses the archive index for firstEvent.
+     The job runs under EmptySource, so the reader is what ends it: once every RUI is out of events it throws the
+     same "EOF" exception CSCFileReader does. A RUI that runs out before the others leaves its FEDs empty until then.
+*/
+//
+// Original Author:  Dylan Parks
+//
+//
+
+// system include files
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// user include files
+#include "FWCore/Framework/interface/Frameworkfwd.h"
+#include "FWCore/Framework/interface/one/EDProducer.h"
+
+#include "FWCore/Framework/interface/Event.h"
+#include "FWCore/Framework/interface/MakerMacros.h"
+
+#include "FWCore/MessageLogger/interface/MessageLogger.h"
+#include "FWCore/ParameterSet/interface/ParameterSet.h"
+#include "FWCore/Utilities/interface/Exception.h"
+
+#include "DataFormats/FEDRawData/interface/FEDRawDataCollection.h"
+
+#include "MiniCSC/MiniCSC/interface/MiniCSCArchive.h"
+#include "MiniCSC/MiniCSC/interface/RUIPrefetcher.h"
+
+//
+// class declaration
+//
+
+class MiniCSCPrefetchRawReader : public edm::one::EDProducer<> {
+public:
+  explicit MiniCSCPrefetchRawReader(const edm::ParameterSet &);
+
+private:
+  // Config =========================================================
+
+  /// RUI name -> its reader
+  std::map<std::string, std::unique_ptr<RUIEventSource>> ruis_;
+  /// FED id -> RUIs whose events are concatenated into it
+  std::map<unsigned int, std::vector<std::string>> feds_;
+
+  // Counters =======================================================
+
+  uint64_t numEvents_ = 0;
+  uint64_t numBytes_ = 0;
+  /// RUIs already out of events, each is warned about once
+  std::vector<std::string> exhausted_;
+
+  // Methods ========================================================
+
+  void produce(edm::Event &, const edm::EventSetup &) override;
+  void endJob() override;
+};
+
+MiniCSCPrefetchRawReader::MiniCSCPrefetchRawReader(const edm::ParameterSet &iConfig) {
+  const size_t blockBytes = iConfig.getUntrackedParameter<unsigned int>("blockSizeMB", 16) << 20;
+  const size_t maxEventBytes = iConfig.getUntrackedParameter<unsigned int>("maxEventSizeMB", 4) << 20;
+  const unsigned int numBuffers = iConfig.getUntrackedParameter<unsigned int>("numBuffers", 4);
+  const bool directIO = iConfig.getUntrackedParameter<bool>("directIO", false);
+  const unsigned int decompressionThreads = iConfig.getUntrackedParameter<unsigned int>("decompressionThreads", 4);
+  const int firstEvent = iConfig.getUntrackedParameter<int>("firstEvent", 0);
+
+  // Same parameter layout as CSCFileReader
+  for (const std::string &name : iConfig.getParameterNamesForType<std::vector<std::string>>(false)) {
+    const std::vector<std::string> values = iConfig.getUntrackedParameter<std::vector<std::string>>(name);
+    if (name.compare(0, 3, "FED") == 0) {
+      feds_[std::stoul(name.substr(3))] = values;
+    } else if (name.compare(0, 3, "RUI") == 0 && !values.empty()) {
+      const size_t numArchives = std::count_if(values.begin(), values.end(), minicscarchive::isArchive);
+      if (numArchives == values.size()) {
+        ruis_[name] = std::make_unique<minicscarchive::Reader>(values, decompressionThreads);
+      } else if (numArchives == 0) {
+        ruis_[name] = std::make_unique<RUIPrefetcher>(values, blockBytes, maxEventBytes, numBuffers, directIO);
+      } else {
+        throw cms::Exception("Configuration") << name << " mixes raw files and " << minicscarchive::kExtension
+                                              << " archives";
+      }
+    }
+  }
+  for (const auto &fed : feds_) {
+    for (const std::string &rui : fed.second) {
+      if (ruis_.find(rui) == ruis_.end()) {
+        throw cms::Exception("Configuration") << "FED" << fed.first << " reads " << rui << " which has no files";
+      }
+    }
+  }
+
+  // Skip ahead, archives jump there through their index
+  for (auto &rui : ruis_) {
+    rui.second->skip(firstEvent);
+  }
+
+  std::cout << "Prefetching raw reader: " << ruis_.size() << " RUI(s) into " << feds_.size() << " FED(s), "
+            << numBuffers << " x " << (blockBytes >> 20) << " MB buffers per RUI" << std::endl;
+
+  produces<FEDRawDataCollection>();
+}
+
+// ------------ method called for each event  ------------
+void MiniCSCPrefetchRawReader::produce(edm::Event &iEvent, const edm::EventSetup &iSetup) {
+  auto rawProduct = std::make_unique<FEDRawDataCollection>();
+
+  // One event from every RUI, pointers stay valid until the next call on the same reader
+  std::map<std::string, std::pair<const uint16_t *, size_t>> ruiEvents;
+  for (auto &rui : ruis_) {
+    const uint16_t *event = nullptr;
+    size_t words = 0;
+    if (rui.second->next(event, words)) {
+      ruiEvents[rui.first] = std::make_pair(event, words);
+    } else if (std::find(exhausted_.begin(), exhausted_.end(), rui.first) == exhausted_.end()) {
+      edm::LogWarning("MiniCSCPrefetchRawReader") << rui.first << " has no more events, producing empty FEDs";
+      exhausted_.push_back(rui.first);
+    }
+  }
+  // Nothing left anywhere, end the job like CSCFileReader
+  if (ruiEvents.empty()) {
+    throw cms::Exception("EOF") << "MiniCSCPrefetchRawReader: no more events after " << numEvents_;
+  }
+
+  for (const auto &fed : feds_) {
+    size_t words = 0;
+    for (const std::string &rui : fed.second) {
+      auto found = ruiEvents.find(rui);
+      if (found != ruiEvents.end()) {
+        words += found->second.second;
+      }
+    }
+    if (words == 0) {
+      continue;
+    }
+    FEDRawData &fedData = rawProduct->FEDData(fed.first);
+    fedData.resize(words * 2);
+    unsigned char *out = fedData.data();
+    for (const std::string &rui : fed.second) {
+      auto found = ruiEvents.find(rui);
+      if (found != ruiEvents.end()) {
+        memcpy(out, found->second.first, found->second.second * 2);
+        out += found->second.second * 2;
+      }
+    }
+    numBytes_ += fedData.size();
+  }
+
+  iEvent.put(std::move(rawProduct));
+  numEvents_++;
+}
+
+// ------------ method called once each job just after ending the event loop
+// ------------
+void MiniCSCPrefetchRawReader::endJob() {
+  std::cout << "Prefetching raw reader events: " << numEvents_ << ", MB: " << (numBytes_ >> 20) << std::endl;
+  for (const auto &rui : ruis_) {
+    // Stalls are the times the event loop waited on the disk
+    std::cout << rui.first << ": stalls " << rui.second->stalls() << ", dropped events "
+              << rui.second->droppedEvents() << std::endl;
+  }
+}
+
+// define this as a plug-in
+DEFINE_FWK_MODULE(MiniCSCPrefetchRawReader);
@@ -0,0 +1,199 @@
+// -*- C++ -*-
+//
+// Package:    MiniCSC/MiniCSC
+// Class:      MiniCSCRawPreFilter
+//
+/**\class MiniCSCRawPreFilter MiniCSCRawPreFilter.cc MiniCSC/MiniCSC/plugins/MiniCSCRawPreFilter.cc
+
+ Description: Rejects empty/noise-only events straight from the FED buffers, before CSCDCCUnpacker runs
+
+ Implementation:
+     Scans the CSC FED payload 64 bits at a time for DMB headers (four words tagged 0x9 followed by four tagged 0xA,
+     the same signature CSCDCCExaminer looks for) and reads nalct, nclct and the active CFEB bits straight from the
+     header words, with the bit layout of CSCDMBHeader2005/CSCDMBHeader2013, without building a CSCDMBHeader. The
+     chamber word count is the distance to the next DMB header or the end of the FED. Nothing else is decoded, so
+     this runs at about memory bandwidth. An event passes if at least one chamber meets every configured minimum.
+     Put it in the path in front of muonCSCDigis so rejected events never reach the unpacker.
+*/
+//
+// Original Author:  Dylan Parks
+//
+//
+
+// system include files
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+// user include files
+#include "FWCore/Framework/interface/Frameworkfwd.h"
+#include "FWCore/Framework/interface/global/EDFilter.h"
+
+#include "FWCore/Framework/interface/Event.h"
+#include "FWCore/Framework/interface/MakerMacros.h"
+
+#include "FWCore/ParameterSet/interface/ConfigurationDescriptions.h"
+#include "FWCore/ParameterSet/interface/ParameterSet.h"
+#include "FWCore/ParameterSet/interface/ParameterSetDescription.h"
+#include "FWCore/Utilities/interface/InputTag.h"
+
+#include "DataFormats/FEDRawData/interface/FEDNumbering.h"
+#include "DataFormats/FEDRawData/interface/FEDRawDataCollection.h"
+
+//
+// class declaration
+//
+
+class MiniCSCRawPreFilter : public edm::global::EDFilter<> {
+public:
+  explicit MiniCSCRawPreFilter(const edm::ParameterSet &);
+
+  static void fillDescriptions(edm::ConfigurationDescriptions &descriptions);
+
+private:
+  // Config =========================================================
+
+  edm::EDGetTokenT<FEDRawDataCollection> rawToken_;
+  /// FEDs to scan, all CSC DCC and DDU FEDs if left empty
+  std::vector<unsigned int> fedIds_;
+  /// DMB format version used to read the headers, 2013 for post-LS1 data
+  uint16_t formatVersion_;
+  /// Minimums a single chamber has to reach for the event to pass
+  uint32_t minALCTs_, minCLCTs_, minActiveCFEBs_, minChamberWords_;
+
+  // Counters =======================================================
+
+  mutable std::atomic<uint64_t> numEvents_{0};
+  mutable std::atomic<uint64_t> numPassed_{0};
+  mutable std::atomic<uint64_t> numChambers_{0};
+
+  // Methods ========================================================
+
+  bool filter(edm::StreamID, edm::Event &, const edm::EventSetup &) const override;
+  void endJob() override;
+  /// Scans one FED for DMB headers, returns true as soon as one chamber passes. Adds the chambers seen to numSeen.
+  bool scanFED(const FEDRawData &fedData, uint64_t &numSeen) const;
+  /// True if the chamber whose DMB header starts at dmb meets the minimums, words is the size of its block
+  bool chamberPasses(const uint16_t *dmb, size_t words) const;
+};
+
+MiniCSCRawPreFilter::MiniCSCRawPreFilter(const edm::ParameterSet &iConfig)
+    : rawToken_(consumes<FEDRawDataCollection>(iConfig.getParameter<edm::InputTag>("InputObjects"))),
+      fedIds_(iConfig.getParameter<std::vector<unsigned int>>("fedIds")),
+      formatVersion_(iConfig.getParameter<uint32_t>("formatVersion")),
+      minALCTs_(iConfig.getParameter<uint32_t>("minALCTs")),
+      minCLCTs_(iConfig.getParameter<uint32_t>("minCLCTs")),
+      minActiveCFEBs_(iConfig.getParameter<uint32_t>("minActiveCFEBs")),
+      minChamberWords_(iConfig.getParameter<uint32_t>("minChamberWords")) {
+  if (fedIds_.empty()) {
+    for (unsigned int id = FEDNumbering::MINCSCFEDID; id <= FEDNumbering::MAXCSCFEDID; id++) {
+      fedIds_.push_back(id);
+    }
+    for (unsigned int id = FEDNumbering::MINCSCDDUFEDID; id <= FEDNumbering::MAXCSCDDUFEDID; id++) {
+      fedIds_.push_back(id);
+    }
+  }
+}
+
+void MiniCSCRawPreFilter::fillDescriptions(edm::ConfigurationDescriptions &descriptions) {
+  edm::ParameterSetDescription desc;
+  desc.add<edm::InputTag>("InputObjects", edm::InputTag("rawDataCollector"));
+  desc.add<std::vector<unsigned int>>("fedIds", {})->setComment("FEDs to scan, empty = all CSC FEDs");
+  desc.add<uint32_t>("formatVersion", 2013);
+  desc.add<uint32_t>("minALCTs", 0)->setComment("Minimum ALCTs (DMB header nalct) in one chamber");
+  desc.add<uint32_t>("minCLCTs", 0)->setComment("Minimum CLCTs (DMB header nclct) in one chamber");
+  desc.add<uint32_t>("minActiveCFEBs", 1)->setComment("Minimum CFEBs flagged active in one chamber");
+  desc.add<uint32_t>("minChamberWords", 0)->setComment("Minimum 16-bit words in one chamber block");
+  descriptions.add("miniCSCRawPreFilter", desc);
+}
+
+// ------------ method called for each event  ------------
+bool MiniCSCRawPreFilter::filter(edm::StreamID, edm::Event &iEvent, const edm::EventSetup &iSetup) const {
+  edm::Handle<FEDRawDataCollection> rawData;
+  iEvent.getByToken(rawToken_, rawData);
+
+  bool pass = false;
+  uint64_t numSeen = 0;
+  for (unsigned int id : fedIds_) {
+    if (scanFED(rawData->FEDData(id), numSeen)) {
+      pass = true;
+      break;
+    }
+  }
+
+  numEvents_++;
+  numChambers_ += numSeen;
+  if (pass) {
+    numPassed_++;
+  }
+  return pass;
+}
+
+bool MiniCSCRawPreFilter::scanFED(const FEDRawData &fedData, uint64_t &numSeen) const {
+  // Same threshold the unpacker uses for a FED with data
+  if (fedData.size() < 32) {
+    return false;
+  }
+  const uint16_t *buf = reinterpret_cast<const uint16_t *>(fedData.data());
+  const size_t numWords = fedData.size() / 2;
+
+  auto isDMBHeader = [buf](size_t i) {
+    return (buf[i] & 0xF000) == 0x9000 && (buf[i + 1] & 0xF000) == 0x9000 && (buf[i + 2] & 0xF000) == 0x9000 &&
+           (buf[i + 3] & 0xF000) == 0x9000 && (buf[i + 4] & 0xF000) == 0xA000 && (buf[i + 5] & 0xF000) == 0xA000 &&
+           (buf[i + 6] & 0xF000) == 0xA000 && (buf[i + 7] & 0xF000) == 0xA000;
+  };
+
+  // Headers sit on 64-bit boundaries, so step 4 words at a time. A chamber is judged once the next header (or the
+  // end of the FED) gives its size.
+  size_t header = numWords;  // no header seen yet
+  for (size_t i = 0; i + 8 <= numWords; i += 4) {
+    if (!isDMBHeader(i)) {
+      continue;
+    }
+    if (header < numWords) {
+      numSeen++;
+      if (chamberPasses(buf + header, i - header)) {
+        return true;
+      }
+    }
+    header = i;
+    i += 4;  // second half of the header
+  }
+  // Last chamber runs up to the end of the FED (includes the DDU trailer, close enough for a threshold)
+  if (header == numWords) {
+    return false;
+  }
+  numSeen++;
+  return chamberPasses(buf + header, numWords - header);
+}
+
+bool MiniCSCRawPreFilter::chamberPasses(const uint16_t *dmb, size_t words) const {
+  uint32_t nalct, nclct, cfebActive;
+  if (formatVersion_ == 2013) {
+    // 3rd word: cfeb_dav:7 tmb_dav:1 alct_dav:1, 5th word: cfeb_clct_sent:7 (what CSCDMBHeader2013 calls active)
+    nclct = (dmb[2] >> 7) & 0x1;
+    nalct = (dmb[2] >> 8) & 0x1;
+    cfebActive = dmb[4] & 0x7F;
+  } else {
+    // 3rd word: cfeb_dav:5 cfeb_active:5 alct_dav:1 tmb_dav:1, CSCDMBHeader falls back to this for any other version
+    cfebActive = (dmb[2] >> 5) & 0x1F;
+    nalct = (dmb[2] >> 10) & 0x1;
+    nclct = (dmb[2] >> 11) & 0x1;
+  }
+  return nalct >= minALCTs_ && nclct >= minCLCTs_ &&
+         static_cast<uint32_t>(__builtin_popcount(cfebActive)) >= minActiveCFEBs_ && words >= minChamberWords_;
+}
+
+// ------------ method called once each job just after ending the event loop
+// ------------
+void MiniCSCRawPreFilter::endJob() {
+  const double events = numEvents_ > 0 ? static_cast<double>(numEvents_) : 1.;
+  std::cout << "Raw pre-filter events scanned: " << numEvents_ << std::endl;
+  std::cout << "Raw pre-filter events passed: " << numPassed_ << " (" << 100. * numPassed_ / events << "%)"
+            << std::endl;
+  std::cout << "Raw pre-filter chambers per event: " << numChambers_ / events << std::endl;
+}
+
+// define this as a plug-in
+DEFINE_FWK_MODULE(MiniCSCRawPreFilter);
@@ -0,0 +1,227 @@
+// -*- C++ -*-
+//
+// Package:    MiniCSC/MiniCSC
+// Class:      MiniCSCSkimFilter
+//
+/**\class MiniCSCSkimFilter MiniCSCSkimFilter.cc MiniCSC/MiniCSC/plugins/MiniCSCSkimFilter.cc
+
+ Description: Selects events with real clusters from the unpacked digis, to write a reduced EDM file
+
+ Implementation:
+     Strip clusters are found with the same walk MiniCSC uses (minicscsignal::walkStripClusters): fired digis next to
+     each other in a layer, a strip fires when a time bin reaches adcThreshold above pedestal, and strips in the
+     channel mask file are skipped. The cluster charge is the sum of the strip charges. A layer has a fired wiregroup
+     if it has a wire digi outside the mask, as masked wiregroups never reach MiniCSC's plots. MiniCSC can add hot and
+     dead channels to its mask during the job, the skim only knows the ones in channelMaskFile. An event
+     passes if it meets every configured minimum: the largest cluster charge, the number of layers with a strip
+     cluster, the number of layers with a fired wiregroup, and a CLCT if requireCLCT is set.
+     Leave MiniCSC in its own path and put this one in the path the output module selects on, so the histograms still
+     see every event.
+*/
+//
+// Original Author:  Dylan Parks
+//
+//
+
+// system include files
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// user include files
+#include "FWCore/Framework/interface/Frameworkfwd.h"
+#include "FWCore/Framework/interface/global/EDFilter.h"
+
+#include "FWCore/Framework/interface/Event.h"
+#include "FWCore/Framework/interface/MakerMacros.h"
+
+#include "FWCore/ParameterSet/interface/ConfigurationDescriptions.h"
+#include "FWCore/ParameterSet/interface/ParameterSet.h"
+#include "FWCore/ParameterSet/interface/ParameterSetDescription.h"
+#include "FWCore/Utilities/interface/InputTag.h"
+
+#include "DataFormats/CSCDigi/interface/CSCCLCTDigiCollection.h"
+#include "DataFormats/CSCDigi/interface/CSCStripDigiCollection.h"
+#include "DataFormats/CSCDigi/interface/CSCWireDigiCollection.h"
+#include "DataFormats/MuonDetId/interface/CSCDetId.h"
+
+#include "MiniCSC/MiniCSC/interface/CSCChamberGeometry.h"
+#include "MiniCSC/MiniCSC/interface/MiniCSCSignal.h"
+
+//
+// class declaration
+//
+
+class MiniCSCSkimFilter : public edm::global::EDFilter<> {
+public:
+  explicit MiniCSCSkimFilter(const edm::ParameterSet &);
+
+  static void fillDescriptions(edm::ConfigurationDescriptions &descriptions);
+
+private:
+  static const uint16_t kNumLayers = 6;
+  /// Strip numbers the mask can hold, as in MiniCSC
+  static const uint16_t kMaxChannels = 256;
+
+  // Config =========================================================
+
+  edm::EDGetTokenT<CSCStripDigiCollection> stripToken_;
+  edm::EDGetTokenT<CSCWireDigiCollection> wireToken_;
+  edm::EDGetTokenT<CSCCLCTDigiCollection> clctToken_;
+  /// Same meaning as the MiniCSC parameter
+  uint32_t adcThreshold_;
+  /// Minimum charge of the largest strip cluster, ADC
+  double minClusterCharge_;
+  /// Minimum layers with a strip cluster, and with a fired wiregroup
+  uint32_t minStripLayers_, minWireLayers_;
+  bool requireCLCT_;
+  /// Hot and dead strips and wiregroups read from channelMaskFile, by layer
+  std::bitset<kMaxChannels> maskedStrips_[kNumLayers], maskedWires_[kNumLayers];
+
+  // Counters =======================================================
+
+  mutable std::atomic<uint64_t> numEvents_{0};
+  mutable std::atomic<uint64_t> numPassed_{0};
+
+  // Methods ========================================================
+
+  bool filter(edm::StreamID, edm::Event &, const edm::EventSetup &) const override;
+  void endJob() override;
+  /// Largest cluster charge in the event, sets the bit of every layer with a cluster
+  float findStripClusters(const CSCStripDigiCollection &strips, std::bitset<kNumLayers> &layers) const;
+};
+
+MiniCSCSkimFilter::MiniCSCSkimFilter(const edm::ParameterSet &iConfig)
+    : stripToken_(consumes<CSCStripDigiCollection>(iConfig.getParameter<edm::InputTag>("stripDigiTag"))),
+      wireToken_(consumes<CSCWireDigiCollection>(iConfig.getParameter<edm::InputTag>("wireDigiTag"))),
+      adcThreshold_(iConfig.getParameter<uint32_t>("adcThreshold")),
+      minClusterCharge_(iConfig.getParameter<double>("minClusterCharge")),
+      minStripLayers_(iConfig.getParameter<uint32_t>("minStripLayers")),
+      minWireLayers_(iConfig.getParameter<uint32_t>("minWireLayers")),
+      requireCLCT_(iConfig.getParameter<bool>("requireCLCT")) {
+  // The CLCTs are only read when they decide something
+  if (requireCLCT_) {
+    clctToken_ = consumes<CSCCLCTDigiCollection>(iConfig.getParameter<edm::InputTag>("clctDigiTag"));
+  }
+
+  const std::string maskFile = iConfig.getParameter<std::string>("channelMaskFile");
+  if (!maskFile.empty()) {
+    const int numRead = minicscsignal::readChannelMaskFile(
+        maskFile, kNumLayers, kMaxChannels, [this](bool isStrip, int layer, int channel, bool) {
+          (isStrip ? maskedStrips_ : maskedWires_)[layer].set(channel);
+        });
+    if (numRead < 0) {
+      std::cout << "Skim filter channel mask file " << maskFile << " not found, no strips are masked" << std::endl;
+    } else {
+      std::cout << "Skim filter channel mask: " << numRead << " channels from " << maskFile << std::endl;
+    }
+  }
+}
+
+void MiniCSCSkimFilter::fillDescriptions(edm::ConfigurationDescriptions &descriptions) {
+  edm::ParameterSetDescription desc;
+  desc.add<edm::InputTag>("stripDigiTag", edm::InputTag("muonCSCDigis", "MuonCSCStripDigi"));
+  desc.add<edm::InputTag>("wireDigiTag", edm::InputTag("muonCSCDigis", "MuonCSCWireDigi"));
+  desc.add<edm::InputTag>("clctDigiTag", edm::InputTag("muonCSCDigis", "MuonCSCCLCTDigi"));
+  desc.add<uint32_t>("adcThreshold", 32)->setComment("ADC above pedestal for a fired strip, as in MiniCSC");
+  desc.add<double>("minClusterCharge", 0.)->setComment("Minimum charge of the largest strip cluster, ADC");
+  desc.add<uint32_t>("minStripLayers", 1)->setComment("Minimum layers with a strip cluster");
+  desc.add<uint32_t>("minWireLayers", 0)->setComment("Minimum layers with a fired wiregroup");
+  desc.add<bool>("requireCLCT", false)->setComment("Only pass events with at least one CLCT");
+  desc.add<std::string>("channelMaskFile", "")
+      ->setComment("Strips and wiregroups to skip, same file format as in MiniCSC");
+  descriptions.add("miniCSCSkimFilter", desc);
+}
+
+// ------------ method called for each event  ------------
+bool MiniCSCSkimFilter::filter(edm::StreamID, edm::Event &iEvent, const edm::EventSetup &iSetup) const {
+  numEvents_++;
+
+  // Cheapest checks first, every one of them has to pass
+  if (requireCLCT_) {
+    const CSCCLCTDigiCollection &clcts = iEvent.get(clctToken_);
+    if (clcts.begin() == clcts.end()) {
+      return false;
+    }
+  }
+
+  if (minWireLayers_ > 0) {
+    std::bitset<kNumLayers> wireLayers;
+    const CSCWireDigiCollection &wires = iEvent.get(wireToken_);
+    for (auto wi = wires.begin(); wi != wires.end(); wi++) {
+      const uint16_t layer = CSCDetId((*wi).first).layer() - 1;
+      // MiniCSC drops masked wiregroups before counting anything, a layer needs one that is not masked
+      for (auto wireIt = (*wi).second.first; wireIt != (*wi).second.second; ++wireIt) {
+        const int wiregroup = wireIt->getWireGroup();
+        if (wiregroup < 0 || wiregroup >= kMaxChannels || !maskedWires_[layer][wiregroup]) {
+          wireLayers.set(layer);
+          break;
+        }
+      }
+    }
+    if (wireLayers.count() < minWireLayers_) {
+      return false;
+    }
+  }
+
+  if (minStripLayers_ > 0 || minClusterCharge_ > 0) {
+    std::bitset<kNumLayers> stripLayers;
+    const float maxCharge = findStripClusters(iEvent.get(stripToken_), stripLayers);
+    if (stripLayers.count() < minStripLayers_ || maxCharge < minClusterCharge_) {
+      return false;
+    }
+  }
+
+  numPassed_++;
+  return true;
+}
+
+float MiniCSCSkimFilter::findStripClusters(const CSCStripDigiCollection &strips,
+                                           std::bitset<kNumLayers> &layers) const {
+  float maxCharge = 0.f;
+  for (auto si = strips.begin(); si != strips.end(); si++) {
+    const CSCDetId id((*si).first);
+    const uint16_t layer = id.layer() - 1;
+    // Both chamber types number the strips like this, see CSCChamberGeometry.h
+    const int stripOffset = cscgeometry::me11StripOffset(id.ring());
+    float clusterCharge = 0.f;
+    minicscsignal::walkStripClusters(
+        (*si).second.first,
+        (*si).second.second,
+        [&](const CSCStripDigi &digi) {
+          const int strip = digi.getStrip() + stripOffset;
+          return strip >= 0 && strip < kMaxChannels && maskedStrips_[layer][strip];
+        },
+        [](const CSCStripDigi &) {},
+        [&](const CSCStripDigi &digi) {
+          const std::vector<int> adcCounts = digi.getADCCounts();
+          const float ped = digi.pedestal();
+          if (!minicscsignal::hasSignal(adcCounts, ped, adcThreshold_)) {
+            return false;
+          }
+          clusterCharge += minicscsignal::stripCharge(adcCounts, ped);
+          layers.set(layer);
+          return true;
+        },
+        [&]() {
+          maxCharge = std::max(maxCharge, clusterCharge);
+          clusterCharge = 0.f;
+        });
+  }
+  return maxCharge;
+}
+
+// ------------ method called once each job just after ending the event loop
+// ------------
+void MiniCSCSkimFilter::endJob() {
+  const double events = numEvents_ > 0 ? static_cast<double>(numEvents_) : 1.;
+  std::cout << "Skim filter events: " << numEvents_ << ", passed: " << numPassed_ << " ("
+            << 100. * numPassed_ / events << "%)" << std::endl;
+}
+
+// define this as a plug-in
+DEFINE_FWK_MODULE(MiniCSCSkimFilter);
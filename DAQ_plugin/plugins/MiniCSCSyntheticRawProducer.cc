@@ -0,0 +1,304 @@
+// -*- C++ -*-
+//
+// Package:    MiniCSC/MiniCSC
+// Class:      MiniCSCSyntheticRawProducer
+//
+/**\class MiniCSCSyntheticRawProducer MiniCSCSyntheticRawProducer.cc MiniCSC/MiniCSC/plugins/MiniCSCSyntheticRawProducer.cc
+
+ Description: Generates synthetic DDU raw events for benchmarking the CSC unpacker and MiniCSC
+
+ Implementation:
+     Digis are generated per chamber and packed with the same CSCEventData/CSCDDUEventData classes the CSC packer
+     uses, so the output is read by CSCDCCUnpacker exactly like a RUI file from CSCFileReader. Every active CFEB is
+     read out on all 16 strips (like the real hardware), so the number of CFEBs drives the strip digi count and the
+     occupancy only decides where the signal clusters go.
+     The generator is seeded from the config so two benchmark runs see identical events.
+*/
+//
+// Original Author:  Dylan Parks
+//
+//
+
+// system include files
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+// user include files
+#include "FWCore/Framework/interface/Frameworkfwd.h"
+#include "FWCore/Framework/interface/one/EDProducer.h"
+
+#include "FWCore/Framework/interface/Event.h"
+#include "FWCore/Framework/interface/MakerMacros.h"
+
+#include "FWCore/ParameterSet/interface/ConfigurationDescriptions.h"
+#include "FWCore/ParameterSet/interface/ParameterSet.h"
+#include "FWCore/ParameterSet/interface/ParameterSetDescription.h"
+#include "FWCore/Utilities/interface/CRC16.h"
+#include "FWCore/Utilities/interface/Exception.h"
+
+#include "DataFormats/FEDRawData/interface/FEDRawDataCollection.h"
+#include "DataFormats/FEDRawData/interface/FEDTrailer.h"
+
+#include "DataFormats/CSCDigi/interface/CSCConstants.h"
+#include "DataFormats/CSCDigi/interface/CSCStripDigi.h"
+#include "DataFormats/CSCDigi/interface/CSCWireDigi.h"
+
+#include "EventFilter/CSCRawToDigi/interface/CSCDDUEventData.h"
+#include "EventFilter/CSCRawToDigi/interface/CSCEventData.h"
+#include "EventFilter/CSCRawToDigi/interface/bitset_append.h"
+
+//
+// class declaration
+//
+
+class MiniCSCSyntheticRawProducer : public edm::one::EDProducer<> {
+public:
+  explicit MiniCSCSyntheticRawProducer(const edm::ParameterSet &);
+
+  static void fillDescriptions(edm::ConfigurationDescriptions &descriptions);
+
+private:
+  // Config =========================================================
+
+  /// FED ids to fill, one DDU per FED
+  std::vector<unsigned int> fedIds_;
+  /// Chambers per DDU, each gets its own DMB slot starting at firstDMB_
+  uint32_t numChambers_;
+  uint32_t vmeCrate_, firstDMB_;
+  /// CSCDetId::iChamberType of the generated chambers, ME1/1 = 2
+  uint32_t chamberType_;
+  /// DMB/DDU format version, 2013 for post-LS1 data
+  uint32_t formatVersion_;
+  /// CFEBs read out per chamber (16 strips each)
+  uint32_t numCFEBs_;
+  /// Samples per strip, the CFEB format only supports 8 or 16
+  uint32_t numTimeBins_;
+  /// Wiregroups per layer that can be hit
+  uint32_t numWiregroups_;
+  /// Probability that a layer has a signal cluster in an event
+  double occupancy_;
+  /// Width in strips of a signal cluster
+  uint32_t clusterWidth_;
+  /// Pedestal and noise RMS in ADC counts
+  double pedestal_, noiseRMS_;
+  /// Peak ADC counts above pedestal on the central strip of a cluster
+  double signalAmplitude_;
+  /// Fraction of events that get bit flips injected into the FED payload
+  double errorRate_;
+  /// Number of bits flipped in a corrupted event
+  uint32_t errorBitFlips_;
+  /// Optional file to write the generated digi counts to at endJob (used by run_benchmark.py)
+  std::string summaryFile_;
+
+  std::mt19937_64 rng_;
+
+  // Counters =======================================================
+
+  uint64_t numEvents_ = 0;
+  uint64_t numStripDigis_ = 0;
+  uint64_t numWireDigis_ = 0;
+  uint64_t numCorrupted_ = 0;
+  uint64_t numBytes_ = 0;
+
+  // Methods ========================================================
+
+  void produce(edm::Event &, const edm::EventSetup &) override;
+  void endJob() override;
+  /// Fills one chamber worth of digis
+  void fillChamber(CSCEventData &cscData);
+  /// Flips errorBitFlips_ random bits in the payload between the FED header and trailer
+  void injectErrors(FEDRawData &fedData);
+};
+
+MiniCSCSyntheticRawProducer::MiniCSCSyntheticRawProducer(const edm::ParameterSet &iConfig)
+    : fedIds_(iConfig.getParameter<std::vector<unsigned int>>("fedIds")),
+      numChambers_(iConfig.getParameter<uint32_t>("numChambers")),
+      vmeCrate_(iConfig.getParameter<uint32_t>("vmeCrate")),
+      firstDMB_(iConfig.getParameter<uint32_t>("firstDMB")),
+      chamberType_(iConfig.getParameter<uint32_t>("chamberType")),
+      formatVersion_(iConfig.getParameter<uint32_t>("formatVersion")),
+      numCFEBs_(iConfig.getParameter<uint32_t>("numCFEBs")),
+      numTimeBins_(iConfig.getParameter<uint32_t>("numTimeBins")),
+      numWiregroups_(iConfig.getParameter<uint32_t>("numWiregroups")),
+      occupancy_(iConfig.getParameter<double>("occupancy")),
+      clusterWidth_(iConfig.getParameter<uint32_t>("clusterWidth")),
+      pedestal_(iConfig.getParameter<double>("pedestal")),
+      noiseRMS_(iConfig.getParameter<double>("noiseRMS")),
+      signalAmplitude_(iConfig.getParameter<double>("signalAmplitude")),
+      errorRate_(iConfig.getParameter<double>("errorRate")),
+      errorBitFlips_(iConfig.getParameter<uint32_t>("errorBitFlips")),
+      summaryFile_(iConfig.getUntrackedParameter<std::string>("summaryFile")),
+      rng_(iConfig.getParameter<uint32_t>("seed")) {
+  if (numTimeBins_ != 8 && numTimeBins_ != 16) {
+    throw cms::Exception("Configuration") << "numTimeBins must be 8 or 16, got " << numTimeBins_;
+  }
+  if (numCFEBs_ < 1 || numCFEBs_ > CSCConstants::MAX_CFEBS_RUN2) {
+    throw cms::Exception("Configuration") << "numCFEBs must be in 1.." << CSCConstants::MAX_CFEBS_RUN2;
+  }
+  // DMB slot 6 is the crate controller, so the slots available to chambers are 1-5 and 7-10
+  const uint32_t lastDMB = firstDMB_ + numChambers_ - 1;
+  if (firstDMB_ < 1 || numChambers_ < 1 || lastDMB + ((firstDMB_ <= 6 && lastDMB >= 6) ? 1 : 0) > 10) {
+    throw cms::Exception("Configuration") << "numChambers does not fit into DMB slots starting at " << firstDMB_;
+  }
+
+  std::cout << "Synthetic raw: " << numChambers_ << " chamber(s), " << numCFEBs_ << " CFEB(s), " << numTimeBins_
+            << " time bins, occupancy " << occupancy_ << ", error rate " << errorRate_ << std::endl;
+
+  produces<FEDRawDataCollection>();
+}
+
+void MiniCSCSyntheticRawProducer::fillDescriptions(edm::ConfigurationDescriptions &descriptions) {
+  edm::ParameterSetDescription desc;
+  desc.add<std::vector<unsigned int>>("fedIds", {838})->setComment("DDU FED ids to fill");
+  desc.add<uint32_t>("numChambers", 1)->setComment("Chambers per DDU");
+  desc.add<uint32_t>("vmeCrate", 1);
+  desc.add<uint32_t>("firstDMB", 2);
+  desc.add<uint32_t>("chamberType", 2)->setComment("CSCDetId::iChamberType, ME1/1 = 2");
+  desc.add<uint32_t>("formatVersion", 2013);
+  desc.add<uint32_t>("numCFEBs", 5)->setComment("CFEBs read out per chamber");
+  desc.add<uint32_t>("numTimeBins", 8)->setComment("Samples per strip, 8 or 16");
+  desc.add<uint32_t>("numWiregroups", 48);
+  desc.add<double>("occupancy", 0.3)->setComment("Probability of a signal cluster per layer per event");
+  desc.add<uint32_t>("clusterWidth", 3);
+  desc.add<double>("pedestal", 600.);
+  desc.add<double>("noiseRMS", 3.);
+  desc.add<double>("signalAmplitude", 300.);
+  desc.add<double>("errorRate", 0.)->setComment("Fraction of events with corrupted FED payload");
+  desc.add<uint32_t>("errorBitFlips", 4);
+  desc.add<uint32_t>("seed", 12345);
+  desc.addUntracked<std::string>("summaryFile", "");
+  descriptions.add("miniCSCSyntheticRaw", desc);
+}
+
+// ------------ method called for each event  ------------
+void MiniCSCSyntheticRawProducer::produce(edm::Event &iEvent, const edm::EventSetup &iSetup) {
+  auto rawProduct = std::make_unique<FEDRawDataCollection>();
+  std::uniform_real_distribution<double> uniform(0., 1.);
+
+  const unsigned l1a = iEvent.id().event();
+  const unsigned bxn = l1a % 3564;
+  // DDU header format version, 0x6 and above is the post-LS1 layout
+  const unsigned dduFormat = formatVersion_ >= 2013 ? 0x6 : 0x5;
+
+  for (unsigned int fedId : fedIds_) {
+    CSCDDUHeader dduHeader(bxn, l1a, fedId, dduFormat);
+    CSCDDUEventData dduData(dduHeader);
+
+    int dmb = firstDMB_;
+    for (uint32_t iChamber = 0; iChamber < numChambers_; iChamber++, dmb++) {
+      if (dmb == 6) {
+        dmb++;
+      }
+      CSCEventData cscData(chamberType_, formatVersion_);
+      cscData.setEventInformation(bxn, l1a);
+      cscData.dmbHeader()->setCrateAddress(vmeCrate_, dmb);
+      fillChamber(cscData);
+      dduData.add(cscData, dmb, iChamber, formatVersion_);
+    }
+
+    boost::dynamic_bitset<> dduBits = dduData.pack();
+    FEDRawData &fedData = rawProduct->FEDData(fedId);
+    fedData.resize(dduBits.size() / 8);
+    bitset_utilities::bitsetToChar(dduBits, fedData.data());
+    FEDTrailer::set(fedData.data() + (fedData.size() - 8),
+                    fedData.size() / 8,
+                    evf::compute_crc(fedData.data(), fedData.size()),
+                    0,
+                    0);
+
+    if (errorRate_ > 0. && uniform(rng_) < errorRate_) {
+      injectErrors(fedData);
+      numCorrupted_++;
+    }
+    numBytes_ += fedData.size();
+  }
+
+  iEvent.put(std::move(rawProduct));
+  numEvents_++;
+}
+
+void MiniCSCSyntheticRawProducer::fillChamber(CSCEventData &cscData) {
+  std::uniform_real_distribution<double> uniform(0., 1.);
+  std::normal_distribution<double> noise(0., noiseRMS_);
+
+  const uint32_t numStrips = numCFEBs_ * 16;
+  // Rough CFEB shaper response sampled every 50ns, peaking in bin 4 of 8
+  static const double pulseShape8[8] = {0., 0., 0.15, 0.65, 1., 0.8, 0.5, 0.25};
+
+  std::vector<int> adcCounts(numTimeBins_);
+  for (int layer = 1; layer <= 6; layer++) {
+    // Decide where (if anywhere) the signal cluster for this layer goes
+    const bool hasCluster = uniform(rng_) < occupancy_;
+    uint32_t centerStrip = 0;
+    if (hasCluster) {
+      centerStrip = 1 + static_cast<uint32_t>(uniform(rng_) * numStrips);
+      const uint32_t wiregroup = 1 + static_cast<uint32_t>(uniform(rng_) * numWiregroups_);
+      // Anode time bins are 25ns, the hit is placed in bin 7-8 with the usual one bin jitter
+      const unsigned tbinb = 0x3u << (6 + static_cast<unsigned>(uniform(rng_) * 2));
+      cscData.add(CSCWireDigi(wiregroup, tbinb), layer);
+      numWireDigis_++;
+    }
+
+    for (uint32_t strip = 1; strip <= numStrips; strip++) {
+      // Charge sharing falls off by half per strip away from the cluster center
+      double scale = 0.;
+      if (hasCluster) {
+        const uint32_t distance = strip > centerStrip ? strip - centerStrip : centerStrip - strip;
+        if (2 * distance < clusterWidth_) {
+          scale = signalAmplitude_ / static_cast<double>(1u << distance);
+        }
+      }
+      for (uint32_t tbin = 0; tbin < numTimeBins_; tbin++) {
+        const double shape = tbin < 8 ? pulseShape8[tbin] : pulseShape8[7] * std::exp(-0.5 * (tbin - 7.));
+        adcCounts[tbin] = std::clamp(static_cast<int>(pedestal_ + scale * shape + noise(rng_)), 0, 4095);
+      }
+      cscData.add(CSCStripDigi(strip, adcCounts), layer);
+      numStripDigis_++;
+    }
+  }
+}
+
+void MiniCSCSyntheticRawProducer::injectErrors(FEDRawData &fedData) {
+  // Leave the 64-bit FED header and trailer alone so the event still reaches the examiner
+  const size_t headerBytes = 8, trailerBytes = 8;
+  if (fedData.size() <= headerBytes + trailerBytes) {
+    return;
+  }
+  const size_t payloadBits = (fedData.size() - headerBytes - trailerBytes) * 8;
+  std::uniform_int_distribution<size_t> bitDist(0, payloadBits - 1);
+  unsigned char *payload = fedData.data() + headerBytes;
+  for (uint32_t i = 0; i < errorBitFlips_; i++) {
+    const size_t bit = bitDist(rng_);
+    payload[bit / 8] ^= static_cast<unsigned char>(1u << (bit % 8));
+  }
+}
+
+// ------------ method called once each job just after ending the event loop
+// ------------
+void MiniCSCSyntheticRawProducer::endJob() {
+  const double events = numEvents_ > 0 ? static_cast<double>(numEvents_) : 1.;
+  std::cout << "Synthetic events generated: " << numEvents_ << std::endl;
+  std::cout << "Strip digis per event: " << numStripDigis_ / events << std::endl;
+  std::cout << "Wire digis per event: " << numWireDigis_ / events << std::endl;
+  std::cout << "FED bytes per event: " << numBytes_ / events << std::endl;
+  std::cout << "Corrupted events: " << numCorrupted_ << std::endl;
+
+  // Plain key = value so the benchmark driver can read it without a parser
+  if (!summaryFile_.empty()) {
+    std::ofstream summary(summaryFile_);
+    summary << "events = " << numEvents_ << "\n"
+            << "stripDigis = " << numStripDigis_ << "\n"
+            << "wireDigis = " << numWireDigis_ << "\n"
+            << "fedBytes = " << numBytes_ << "\n"
+            << "corrupted = " << numCorrupted_ << "\n";
+  }
+}
+
+// define this as a plug-in
+DEFINE_FWK_MODULE(MiniCSCSyntheticRawProducer);
@@ -14,6 +14,41 @@ options.inputFiles = "file:out_numEvent5000.root"
 options.register(
     "debug", False, VarParsing.multiplicity.singleton, VarParsing.varType.bool
 )
+options.register(
+    "darkRateMode",
+    "",
+    VarParsing.multiplicity.singleton,
+    VarParsing.varType.string,
+    "Dark rate histograms: window (random trigger, live time = readout window per event). Empty to disable",
+)
+options.register(
+    "checkpoint",
+    "",
+    VarParsing.multiplicity.singleton,
+    VarParsing.varType.string,
+    "Side file for periodic checkpoints of the MiniCSC histograms, empty to disable",
+)
+options.register(
+    "resume",
+    False,
+    VarParsing.multiplicity.singleton,
+    VarParsing.varType.bool,
+    "Start from the checkpoint file, the source skips the events it already holds (same inputFiles as the crashed job)",
+)
+options.register(
+    "preFilter",
+    False,
+    VarParsing.multiplicity.singleton,
+    VarParsing.varType.bool,
+    "Skip events without CFEB data before unpacking (source runs, not with darkRateMode or resume)",
+)
+options.register(
+    "skim",
+    False,
+    VarParsing.multiplicity.singleton,
+    VarParsing.varType.bool,
+    "Only write events with a real cluster, and only their strip, wire and CLCT digis, to the EDM output",
+)
 options.parseArguments()
 # end command line arguments
 
@@ -47,10 +82,35 @@ process.source = cms.Source(
     # rootFileName = cms.untracked.string(options.outputFile),
 )
 
+# Dark rates: every event MiniCSC sees is one readout window of live time, the empty events the pre-filter drops are
+# live time too. Without them the live time is too short and every rate too high.
+if options.darkRateMode and options.preFilter:
+    raise RuntimeError("darkRateMode needs preFilter=False, the live time counts the events MiniCSC sees")
+
+# Resume: the source skips the events the checkpoint already holds, so they are not even read. The last one is still
+# read, MiniCSC only compares its id with the one the checkpoint ended at. The checkpoint counts the events MiniCSC
+# analyzed, which is only the number of input events without the pre-filter.
+if options.resume and options.checkpoint:
+    if options.preFilter:
+        raise RuntimeError("resume needs preFilter=False, the checkpoint does not count the filtered events")
+    import ROOT
+
+    checkpointFile = ROOT.TFile.Open(options.checkpoint)
+    if checkpointFile and not checkpointFile.IsZombie():
+        numEventsProc = checkpointFile.Get("numEventsProc")
+        if numEventsProc and numEventsProc.GetVal() > 1:
+            process.source.skipEvents = cms.untracked.uint32(numEventsProc.GetVal() - 1)
+        checkpointFile.Close()
+
 process.FEVT = cms.OutputModule(
     "PoolOutputModule",
     fileName=cms.untracked.string("testD_27.root"),
-    outputCommands=cms.untracked.vstring("keep *"),
+    outputCommands=cms.untracked.vstring(
+        "keep *",
+        # Nothing downstream reads the unpacker status digis, dropping them lets the unpacker skip building them
+        "drop *_muonCSCDigis_MuonCSC*StatusDigi_*",
+        "keep *_muonCSCDigis_MuonCSCDCCFormatStatusDigi_*",
+    ),
 )
 
 
@@ -62,6 +122,17 @@ process.muonCSCDigis.UseExaminer = True  # should be true!
 process.muonCSCDigis.UseSelectiveUnpacking = True  # should be true!
 
 process.muonCSCDigis.Debug = options.debug
+# Per-stage timing, per-FED byte counts and examiner rejection reasons, written at the end of the job
+process.muonCSCDigis.StatsCSVFile = cms.untracked.string("unpackerStats.csv")
+# Count examiner errors into the stats file instead of storing a format status digi for every bad FED
+process.muonCSCDigis.ErrorSummaryMode = cms.untracked.bool(True)
+process.muonCSCDigis.ErrorDetailLimit = cms.untracked.uint32(10)
+# Region of interest: only decode the readout slot the miniCSC is plugged into (crate/DMB as in the DMB header).
+# Chambers outside the ROI are skipped before their CSCEventData is built. Empty lists unpack everything.
+# process.muonCSCDigis.ROIFEDs = cms.vuint32(838)
+# process.muonCSCDigis.ROICrates = cms.vuint32(1)
+# process.muonCSCDigis.ROIDMBs = cms.vuint32(2)
+# process.muonCSCDigis.ROICFEBs = cms.vuint32(0, 1, 2, 3, 4)
 
 
 process.test904 = cms.EDAnalyzer(
@@ -72,18 +143,126 @@ process.test904 = cms.EDAnalyzer(
     clctDigiTag=cms.InputTag("muonCSCDigis", "MuonCSCCLCTDigi"),
     # Configuration tags
     rootFileName=cms.untracked.string("output.root"),
+    # Chamber on the stand: "miniCSC" or "ME11" (full size ME1/1). Sets the strip/wiregroup ranges of the plots.
+    chamberType=cms.untracked.string("miniCSC"),
     # Hardcoded width of charge spectra in strips.
     # When plotting change spectra it will use x number of strips in it's analysis.
     # Cadmiun should be between 3 and 5.
     # NOTE: Based on fired strips graph, values of 7 or 8 could also be good. After 8 though, really only seems to be noise.
     stripWidthCharges=cms.uint32(5),
+    # Rebin factors of the coarser charge spectra written to /Cathode/chargeRebin<N>/, so plots that rebin anyway
+    # (MiniCSCData::ChargeSpectra(layer, rebin)) read a fraction of the data. Each has to divide stripWidthCharges*4096.
+    chargePyramidLevels=cms.untracked.vuint32(4, 16, 32, 128),
     # Controls threshold needed for valid strip signal.
     # If any timebin - pedestal > threshold then we consider it a valid signal.
     # Real CSCs use 13, experimentation is allowed. 32 has worked well.
     adcThreshold=cms.uint32(32),
+    # Strip charge in the charge spectra: "sum" adds up all 8 time bins (pedestal noise included),
+    # "template" uses the charge of the fitted CFEB pulse. The fit runs either way for the pulse time plots.
+    chargeMethod=cms.untracked.string("sum"),
+    # CFEB shaper peaking time in ns, sets the pulse template
+    pulsePeakingTime=cms.untracked.double(100.0),
+    # Anode-cathode matching for the gain maps (Coincidence/gainMap): a strip cluster is paired with the wiregroup
+    # cluster closest in time, at most coincidenceWindowBX away. Set cathodeTimeOffsetBX from the peak of
+    # Coincidence/coincidenceTimeDiff.
+    coincidenceWindowBX=cms.untracked.uint32(2),
+    cathodeTimeOffsetBX=cms.untracked.int32(0),
+    # Dark rate mode (DarkRate/ folder): hits per channel divided by live time and area.
+    # window (the only mode): every event adds darkRateWindowNs of live time, so take the run with a random trigger.
+    # The raw data has no clock for the time between events, the event time and orbit come from EmptySource.
+    darkRateMode=cms.untracked.string(options.darkRateMode),
+    darkRateWindowNs=cms.untracked.double(400.0),
+    darkRateFlushEvents=cms.untracked.uint32(10000),
+    # NOTE: Placeholders, set these to the chamber's real strip/wiregroup/layer areas to get Hz/cm^2
+    stripAreaCm2=cms.untracked.double(1.0),
+    wiregroupAreaCm2=cms.untracked.double(1.0),
+    layerAreaCm2=cms.untracked.double(1.0),
+    # Afterpulse/correlated noise analysis (Afterpulse/ folder): each event is compared with the last
+    # afterpulseDepth events. Layers whose largest cluster was above afterpulseChargeThreshold ADC count as high
+    # charge signals. 0 turns it off. The L1A and BXN of each event are read from the raw data in rawDataTag: the
+    # time plots are modulo one orbit (89 us), the BXN has no orbit counter above it.
+    rawDataTag=process.muonCSCDigis.InputObjects,
+    afterpulseDepth=cms.untracked.uint32(32),
+    afterpulseChargeThreshold=cms.untracked.double(2000.0),
+    # Checkpoints: the accumulated histograms and counters are written to checkpointFile every checkpointEvents
+    # events, in the background. A crashed job is rerun with resume=True and continues where the checkpoint ends,
+    # the source skips the events before that (see process.source above).
+    checkpointFile=cms.untracked.string(options.checkpoint),
+    checkpointEvents=cms.untracked.uint32(100000),
+    resumeFromCheckpoint=cms.untracked.bool(options.resume),
+    # Output compression: zlib, lz4 (fast, for scratch files) or zstd/lzma (small, for archiving), with its level.
+    # outputThreads streams and compresses the histograms in parallel before one ordered write.
+    outputCompression=cms.untracked.string("zstd"),
+    outputCompressionLevel=cms.untracked.int32(5),
+    outputThreads=cms.untracked.uint32(4),
+    # Every snapshotEvents events the output so far is written to snapshotFile (default <rootFileName>_snapshot.root)
+    # in the background, 0 = off
+    snapshotEvents=cms.untracked.uint32(0),
+    # Hot/dead channel mask. Strips and wiregroups in the mask are skipped before anything is filled.
+    # channelMaskFile is read at the start (e.g. the mask of an earlier run), the final mask goes to
+    # channelMaskOutputFile and into the /Mask/ folder of the root file.
+    channelMaskFile=cms.untracked.string(""),
+    channelMaskOutputFile=cms.untracked.string("channelMask.txt"),
+    # Occupancy is checked every maskWindowEvents events, 0 turns the monitor off.
+    # Hot: more than hotChannelFactor x the layer median (and at least minHotCounts hits).
+    # Dead: less than deadChannelFactor x the layer median.
+    maskWindowEvents=cms.untracked.uint32(5000),
+    hotChannelFactor=cms.untracked.double(10.0),
+    deadChannelFactor=cms.untracked.double(0.05),
+    minHotCounts=cms.untracked.uint32(20),
+)
+
+# Cheap scan of the DMB headers in the raw data, rejected events are never unpacked
+process.cscRawPreFilter = cms.EDFilter(
+    "MiniCSCRawPreFilter",
+    InputObjects=process.muonCSCDigis.InputObjects,
+    fedIds=cms.vuint32(),
+    formatVersion=cms.uint32(2013),
+    # An event passes if one chamber reaches all of these
+    minALCTs=cms.uint32(0),
+    minCLCTs=cms.uint32(0),
+    minActiveCFEBs=cms.uint32(1),
+    minChamberWords=cms.uint32(0),
 )
 
 # process.p = cms.Path( process.muonCSCDigis * process.csc2DRecHits * process.gif)
-process.p = cms.Path(process.muonCSCDigis * process.test904)
+if options.preFilter:
+    process.p = cms.Path(process.cscRawPreFilter * process.muonCSCDigis * process.test904)
+else:
+    process.p = cms.Path(process.muonCSCDigis * process.test904)
+
+# Skim: MiniCSC still sees every event, the EDM output only gets the events the skim path accepts and only the digis
+# MiniCSC reads, so re-analysis reads a small fraction of the data
+process.cscSkimFilter = cms.EDFilter(
+    "MiniCSCSkimFilter",
+    stripDigiTag=process.test904.stripDigiTag,
+    wireDigiTag=process.test904.wireDigiTag,
+    clctDigiTag=process.test904.clctDigiTag,
+    adcThreshold=process.test904.adcThreshold,
+    # An event passes if it reaches all of these
+    minClusterCharge=cms.double(500.0),
+    minStripLayers=cms.uint32(3),
+    minWireLayers=cms.uint32(0),
+    requireCLCT=cms.bool(False),
+    # Strips and wiregroups MiniCSC masks from the start, the ones it flags during the job are not known here
+    channelMaskFile=cms.string(process.test904.channelMaskFile.value()),
+)
+if options.skim:
+    if options.preFilter:
+        process.skimPath = cms.Path(process.cscRawPreFilter * process.muonCSCDigis * process.cscSkimFilter)
+    else:
+        process.skimPath = cms.Path(process.muonCSCDigis * process.cscSkimFilter)
+    process.FEVT.SelectEvents = cms.untracked.PSet(SelectEvents=cms.vstring("skimPath"))
+    process.FEVT.outputCommands = cms.untracked.vstring(
+        "drop *",
+        "keep *_muonCSCDigis_MuonCSCStripDigi_*",
+        "keep *_muonCSCDigis_MuonCSCWireDigi_*",
+        "keep *_muonCSCDigis_MuonCSCCLCTDigi_*",
+    )
 
 process.outpath = cms.EndPath(process.FEVT)
+
+# Must come last: only unpack the status/GEM/RPC/shower collections that some module or output module reads
+from MiniCSC.MiniCSC.customiseCSCUnpackerProducts import customiseUnpackOnlyConsumed
+
+process = customiseUnpackOnlyConsumed(process)
@@ -0,0 +1,148 @@
+# Benchmark configuration for the CSC unpacker and MiniCSC using synthetic raw data.
+# Nothing is read from disk, so this runs anywhere CMSSW is set up. The unpacker still needs the crate/chamber maps:
+# with conditionsFile=<sqlite file> (made once with conddb_import) they are the only conditions loaded and no Frontier
+# connection is needed, otherwise they come from the global tag. stage=generate loads no conditions at all.
+#
+# Usually run through run_benchmark.py, which runs each stage separately and collects the numbers. Example:
+#   cmsRun benchmarkMiniCSC.py stage=analyze maxEvents=10000 occupancy=0.5 numCFEBs=5
+import FWCore.ParameterSet.Config as cms
+
+from Configuration.StandardSequences.Eras import eras
+
+# command line arguments
+from FWCore.ParameterSet.VarParsing import VarParsing
+
+from Configuration.AlCa.GlobalTag import GlobalTag as gtCustomise
+
+options = VarParsing("analysis")
+options.maxEvents = 10000
+options.register(
+    "stage",
+    "analyze",
+    VarParsing.multiplicity.singleton,
+    VarParsing.varType.string,
+    "Last stage to run: generate, unpack or analyze",
+)
+options.register("numChambers", 1, VarParsing.multiplicity.singleton, VarParsing.varType.int)
+options.register("numCFEBs", 5, VarParsing.multiplicity.singleton, VarParsing.varType.int)
+options.register("numTimeBins", 8, VarParsing.multiplicity.singleton, VarParsing.varType.int)
+options.register("occupancy", 0.3, VarParsing.multiplicity.singleton, VarParsing.varType.float)
+options.register("errorRate", 0.0, VarParsing.multiplicity.singleton, VarParsing.varType.float)
+options.register("seed", 12345, VarParsing.multiplicity.singleton, VarParsing.varType.int)
+options.register("threads", 1, VarParsing.multiplicity.singleton, VarParsing.varType.int)
+options.register(
+    "conditionsFile",
+    "",
+    VarParsing.multiplicity.singleton,
+    VarParsing.varType.string,
+    "Local sqlite file with CSCCrateMapRcd and CSCChamberMapRcd",
+)
+options.register(
+    "reportPrefix",
+    "benchmark",
+    VarParsing.multiplicity.singleton,
+    VarParsing.varType.string,
+    "Prefix for the timing json and digi summary files",
+)
+options.parseArguments()
+# end command line arguments
+
+if options.stage not in ("generate", "unpack", "analyze"):
+    raise ValueError("stage must be generate, unpack or analyze, got " + options.stage)
+
+process = cms.Process("BENCH", eras.Run3)
+
+# The unpacker is the only module reading conditions, the synthetic producer and MiniCSC need none
+if options.stage != "generate":
+    if options.conditionsFile:
+        process.cscMapConditions = cms.ESSource(
+            "PoolDBESSource",
+            connect=cms.string("sqlite_file:" + options.conditionsFile),
+            toGet=cms.VPSet(
+                cms.PSet(record=cms.string("CSCCrateMapRcd"), tag=cms.string("CSCCrateMap")),
+                cms.PSet(record=cms.string("CSCChamberMapRcd"), tag=cms.string("CSCChamberMap")),
+            ),
+        )
+    else:
+        process.load("Configuration.StandardSequences.FrontierConditions_GlobalTag_cff")
+        process.GlobalTag = gtCustomise(process.GlobalTag, "auto:run2_data", "")
+
+process.maxEvents = cms.untracked.PSet(input=cms.untracked.int32(options.maxEvents))
+process.options = cms.untracked.PSet(
+    numberOfThreads=cms.untracked.uint32(options.threads),
+    numberOfStreams=cms.untracked.uint32(0),
+    wantSummary=cms.untracked.bool(True),
+)
+
+process.MessageLogger = cms.Service(
+    "MessageLogger",
+    cerr=cms.untracked.PSet(enable=cms.untracked.bool(False)),
+    cout=cms.untracked.PSet(
+        enable=cms.untracked.bool(True),
+        threshold=cms.untracked.string("WARNING"),
+    ),
+)
+
+process.source = cms.Source("EmptySource", firstRun=cms.untracked.uint32(1))
+
+# Per module time per event, throughput and (with jemalloc) bytes allocated per module
+process.FastTimerService = cms.Service(
+    "FastTimerService",
+    enableDQM=cms.untracked.bool(False),
+    printEventSummary=cms.untracked.bool(False),
+    printRunSummary=cms.untracked.bool(False),
+    printJobSummary=cms.untracked.bool(True),
+    writeJSONSummary=cms.untracked.bool(True),
+    jsonFileName=cms.untracked.string(options.reportPrefix + "_" + options.stage + "_timing.json"),
+)
+# Peak RSS and per module memory growth
+process.SimpleMemoryCheck = cms.Service(
+    "SimpleMemoryCheck",
+    ignoreTotal=cms.untracked.int32(1),
+    moduleMemorySummary=cms.untracked.bool(True),
+)
+
+process.rawDataCollector = cms.EDProducer(
+    "MiniCSCSyntheticRawProducer",
+    fedIds=cms.vuint32(838),
+    numChambers=cms.uint32(options.numChambers),
+    vmeCrate=cms.uint32(1),
+    firstDMB=cms.uint32(2),
+    chamberType=cms.uint32(2),
+    formatVersion=cms.uint32(2013),
+    numCFEBs=cms.uint32(options.numCFEBs),
+    numTimeBins=cms.uint32(options.numTimeBins),
+    numWiregroups=cms.uint32(48),
+    occupancy=cms.double(options.occupancy),
+    clusterWidth=cms.uint32(3),
+    pedestal=cms.double(600.0),
+    noiseRMS=cms.double(3.0),
+    signalAmplitude=cms.double(300.0),
+    errorRate=cms.double(options.errorRate),
+    errorBitFlips=cms.uint32(4),
+    seed=cms.uint32(options.seed),
+    summaryFile=cms.untracked.string(options.reportPrefix + "_" + options.stage + "_digis.txt"),
+)
+process.benchmarkSequence = cms.Sequence(process.rawDataCollector)
+
+if options.stage in ("unpack", "analyze"):
+    process.load("EventFilter.CSCRawToDigi.cscUnpacker_cfi")
+    process.muonCSCDigis.InputObjects = cms.InputTag("rawDataCollector")
+    process.muonCSCDigis.UseExaminer = True
+    process.muonCSCDigis.UseSelectiveUnpacking = True
+    process.muonCSCDigis.PrintEventNumber = False
+    process.benchmarkSequence += process.muonCSCDigis
+
+if options.stage == "analyze":
+    process.test904 = cms.EDAnalyzer(
+        "MiniCSC",
+        stripDigiTag=cms.InputTag("muonCSCDigis", "MuonCSCStripDigi"),
+        wireDigiTag=cms.InputTag("muonCSCDigis", "MuonCSCWireDigi"),
+        clctDigiTag=cms.InputTag("muonCSCDigis", "MuonCSCCLCTDigi"),
+        rootFileName=cms.untracked.string(options.reportPrefix + "_output.root"),
+        stripWidthCharges=cms.uint32(5),
+        adcThreshold=cms.uint32(32),
+    )
+    process.benchmarkSequence += process.test904
+
+process.p = cms.Path(process.benchmarkSequence)
@@ -0,0 +1,107 @@
+# Turns off the optional CSCDCCUnpacker collections (status digis, GEM, RPC and shower digis) that nothing in the
+# process reads, so the unpacker does not decode them.
+#
+# A collection counts as read if any module has an InputTag pointing at it, or an output module keeps it. Call this
+# at the very end of the config, after every module and output module has been added:
+#   from MiniCSC.MiniCSC.customiseCSCUnpackerProducts import customiseUnpackOnlyConsumed
+#   process = customiseUnpackOnlyConsumed(process)
+import fnmatch
+
+import FWCore.ParameterSet.Config as cms
+
+# StatusDigiProducts entry -> product instance label
+STATUS_PRODUCTS = {
+    "CFEB": "MuonCSCCFEBStatusDigi",
+    "DMB": "MuonCSCDMBStatusDigi",
+    "TMB": "MuonCSCTMBStatusDigi",
+    "ALCT": "MuonCSCALCTStatusDigi",
+    "DDU": "MuonCSCDDUStatusDigi",
+    "DCC": "MuonCSCDCCStatusDigi",
+}
+
+# Unpacker switch -> product instance labels it controls
+OPTIONAL_PRODUCTS = {
+    "useGEMs": ["MuonGEMPadDigiCluster"],
+    "useRPCs": ["MuonCSCRPCDigi"],
+    "useCSCShowers": [
+        "MuonCSCShowerDigi",
+        "MuonCSCShowerDigiAnode",
+        "MuonCSCShowerDigiCathode",
+        "MuonCSCShowerDigiAnodeALCT",
+    ],
+}
+
+
+def _tag_parts(tag) -> tuple[str, str]:
+    """Returns (module label, instance label) of an InputTag or its "label:instance:process" string form"""
+    if isinstance(tag, cms.InputTag):
+        return tag.getModuleLabel(), tag.getProductInstanceLabel()
+    parts = str(tag).split(":")
+    return parts[0], parts[1] if len(parts) > 1 else ""
+
+
+def _collect_tags(pset, tags: list):
+    """Recursively collects every InputTag used in a module or PSet"""
+    for name in pset.parameterNames_():
+        param = getattr(pset, name)
+        if isinstance(param, cms.InputTag):
+            tags.append(_tag_parts(param))
+        elif isinstance(param, cms.VInputTag):
+            tags.extend(_tag_parts(tag) for tag in param)
+        elif isinstance(param, cms.PSet):
+            _collect_tags(param, tags)
+        elif isinstance(param, cms.VPSet):
+            for sub in param:
+                _collect_tags(sub, tags)
+
+
+def _kept_by_output(output, label: str, instance: str) -> bool:
+    """Applies an output module's keep/drop statements to one unpacker product. Later statements win, like the
+    framework does. The type field is not checked since we only know the labels here."""
+    commands = output.outputCommands if hasattr(output, "outputCommands") else ["keep *"]
+    kept = False
+    for command in commands:
+        action, _, pattern = command.strip().partition(" ")
+        fields = pattern.strip().split("_")
+        if fields == ["*"]:
+            fields = ["*", "*", "*", "*"]
+        if len(fields) != 4:
+            continue
+        if fnmatch.fnmatchcase(label, fields[1]) and fnmatch.fnmatchcase(instance, fields[2]):
+            kept = action == "keep"
+    return kept
+
+
+def consumed_instances(process, unpacker_label: str = "muonCSCDigis") -> set[str]:
+    """Gets the unpacker product instances that are read by a module or written by an output module"""
+    tags = []
+    modules = {}
+    modules.update(process.producers_())
+    modules.update(process.filters_())
+    modules.update(process.analyzers_())
+    for label, module in modules.items():
+        if label != unpacker_label:
+            _collect_tags(module, tags)
+    consumed = {instance for label, instance in tags if label == unpacker_label}
+
+    all_instances = list(STATUS_PRODUCTS.values()) + [i for group in OPTIONAL_PRODUCTS.values() for i in group]
+    for output in process.outputModules_().values():
+        consumed.update(i for i in all_instances if _kept_by_output(output, unpacker_label, i))
+    return consumed
+
+
+def customiseUnpackOnlyConsumed(process, unpacker_label: str = "muonCSCDigis"):
+    """Limits the unpacker's optional collections to the ones consumed in this process"""
+    unpacker = getattr(process, unpacker_label)
+    consumed = consumed_instances(process, unpacker_label)
+
+    unpacker.StatusDigiProducts = cms.vstring(
+        [name for name, instance in STATUS_PRODUCTS.items() if instance in consumed]
+    )
+    if len(unpacker.StatusDigiProducts) == 0:
+        unpacker.UnpackStatusDigis = False
+
+    for switch, instances in OPTIONAL_PRODUCTS.items():
+        if hasattr(unpacker, switch) and getattr(unpacker, switch).value():
+            setattr(unpacker, switch, cms.bool(any(i in consumed for i in instances)))
+    return process
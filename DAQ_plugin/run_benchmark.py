@@ -0,0 +1,119 @@
+import os
+import json
+import argparse
+import subprocess
+
+# Stage name -> module label that does the stage's work in python/benchmarkMiniCSC.py
+STAGES = {
+    "generate": "rawDataCollector",
+    "unpack": "muonCSCDigis",
+    "analyze": "test904",
+}
+
+VERBOSE = False
+
+
+def log(*format: str):
+    if VERBOSE:
+        for msg in format:
+            print(msg, end=" ")
+        print()
+
+
+def run_stage(config: str, stage: str, cms_args: list[str]) -> int:
+    """Runs cmsRun for one benchmark stage.
+
+    Args:
+        config (str): Path to benchmarkMiniCSC.py
+        stage (str): Last stage to run (generate, unpack, analyze)
+        cms_args (list[str]): Extra VarParsing arguments forwarded to the config
+
+    Returns:
+        int: Peak resident set size of the job in kB
+    """
+    cmd = ["cmsRun", config, f"stage={stage}"] + cms_args
+    log("Running:", " ".join(cmd))
+    out = None if VERBOSE else subprocess.DEVNULL
+    proc = subprocess.Popen(cmd, stdout=out, stderr=out)
+    # wait4 gives the rusage of this child only, RUSAGE_CHILDREN would mix stages
+    _, status, usage = os.wait4(proc.pid, 0)
+    if os.waitstatus_to_exitcode(status) != 0:
+        print(f"cmsRun failed for stage {stage}, rerun with -v to see the output")
+        exit(1)
+    return usage.ru_maxrss
+
+
+def read_digis(path: str) -> dict[str, int]:
+    """Reads the key = value summary written by MiniCSCSyntheticRawProducer"""
+    data = {}
+    with open(path, "r") as file:
+        for line in file:
+            key, value = line.split("=")
+            data[key.strip()] = int(value)
+    return data
+
+
+def read_module(path: str, label: str) -> dict:
+    """Gets the FastTimerService json entry for one module label"""
+    with open(path, "r") as file:
+        timing = json.load(file)
+    for module in timing.get("modules", []):
+        if module.get("label") == label:
+            return module
+    print(f"Module {label} not found in {path}")
+    exit(1)
+
+
+if __name__ == "__main__":
+    descr = "Runs the synthetic unpacker/MiniCSC benchmark stage by stage and reports throughput and memory.\n"
+    parser = argparse.ArgumentParser(prog="MiniCSC Benchmark", description=descr)
+    parser.add_argument(
+        "-c",
+        "--config",
+        default=os.path.join(os.path.dirname(os.path.abspath(__file__)), "python", "benchmarkMiniCSC.py"),
+        help="cmsRun benchmark configuration",
+    )
+    parser.add_argument("-n", "--events", type=int, default=10000, help="Events per stage")
+    parser.add_argument("--chambers", type=int, default=1, help="Chambers per DDU")
+    parser.add_argument("--cfebs", type=int, default=5, help="CFEBs read out per chamber")
+    parser.add_argument("--tbins", type=int, default=8, help="Time bins per strip (8 or 16)")
+    parser.add_argument("--occupancy", type=float, default=0.3, help="Signal cluster probability per layer")
+    parser.add_argument("--error-rate", type=float, default=0.0, help="Fraction of corrupted events")
+    parser.add_argument("--conditions", default="", help="Local sqlite file with the CSC crate/chamber maps")
+    parser.add_argument("--prefix", default="benchmark", help="Prefix for the report files")
+    parser.add_argument("-v", "--verbose", action="store_true", help="Show cmsRun output")
+    args = parser.parse_args()
+
+    VERBOSE = args.verbose
+
+    cms_args = [
+        f"maxEvents={args.events}",
+        f"numChambers={args.chambers}",
+        f"numCFEBs={args.cfebs}",
+        f"numTimeBins={args.tbins}",
+        f"occupancy={args.occupancy}",
+        f"errorRate={args.error_rate}",
+        f"reportPrefix={args.prefix}",
+    ]
+    if args.conditions:
+        cms_args.append(f"conditionsFile={args.conditions}")
+
+    print(f"{'Stage':<10}{'Events/s':>12}{'ns/digi':>12}{'kB alloc/evt':>14}{'Peak RSS kB':>14}{'+RSS kB':>10}")
+    prev_rss = 0
+    for stage, label in STAGES.items():
+        rss = run_stage(args.config, stage, cms_args)
+        digis = read_digis(f"{args.prefix}_{stage}_digis.txt")
+        module = read_module(f"{args.prefix}_{stage}_timing.json", label)
+
+        # FastTimerService reports accumulated real time in ms and allocated memory in kB
+        events = max(module.get("events", digis["events"]), 1)
+        time_ms = module.get("time_real", 0.0)
+        evt_per_s = events / (time_ms / 1000.0) if time_ms > 0 else float("inf")
+        num_digis = max(digis["stripDigis"] + digis["wireDigis"], 1)
+        ns_per_digi = time_ms * 1e6 / num_digis
+        alloc_per_evt = module.get("mem_alloc", 0.0) / events
+
+        print(
+            f"{stage:<10}{evt_per_s:>12.1f}{ns_per_digi:>12.2f}{alloc_per_evt:>14.2f}{rss:>14}{rss - prev_rss:>10}"
+        )
+        prev_rss = rss
@@ -0,0 +1,121 @@
+// -*- C++ -*-
+//
+// Package:    MiniCSC/MiniCSC
+// Class:      CSCPulseTemplate
+//
+// Original Author:  Dylan Parks
+//
+//
+
+#include "MiniCSC/MiniCSC/interface/CSCPulseTemplate.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+  /// Peak times tabulated: from the first sample to one bin past the last
+  constexpr float kMaxPeakTime = CSCPulseTemplate::kNumTimeBins * CSCPulseTemplate::kBinWidth;
+  /// Coarse search window around the highest sample, ns
+  constexpr float kSearchWindow = 1.2f * CSCPulseTemplate::kBinWidth;
+  /// Coarse grid spacing in table steps
+  constexpr int kCoarseStride = 8;
+}  // namespace
+
+CSCPulseTemplate::CSCPulseTemplate(float peakingTime, float step) : peakingTime_(peakingTime), step_(step) {
+  numPoints_ = static_cast<int>(kMaxPeakTime / step_) + 1;
+  table_.resize(numPoints_ * kNumTimeBins);
+  norm_.resize(numPoints_);
+  sum_.resize(numPoints_);
+  for (int p = 0; p < numPoints_; p++) {
+    float *row = &table_[p * kNumTimeBins];
+    double norm2 = 0., sum = 0.;
+    for (int i = 0; i < kNumTimeBins; i++) {
+      row[i] = shape(i * kBinWidth - p * step_);
+      norm2 += row[i] * row[i];
+      sum += row[i];
+    }
+    norm_[p] = std::sqrt(norm2);
+    sum_[p] = sum;
+    for (int i = 0; i < kNumTimeBins && norm_[p] > 0.f; i++) {
+      row[i] /= norm_[p];
+    }
+  }
+}
+
+float CSCPulseTemplate::shape(float t) const {
+  const float x = t / peakingTime_ + 1.f;
+  if (x <= 0.f) {
+    return 0.f;
+  }
+  const float x2 = x * x;
+  return x2 * x2 * std::exp(4.f * (1.f - x));
+}
+
+float CSCPulseTemplate::dot(const float *samples, int point) const {
+  const float *row = &table_[point * kNumTimeBins];
+  float d = 0.f;
+  for (int i = 0; i < kNumTimeBins; i++) {
+    d += samples[i] * row[i];
+  }
+  return d;
+}
+
+CSCPulseTemplate::Result CSCPulseTemplate::fit(const float *samples) const {
+  Result result;
+  float energy = 0.f;
+  int highest = 0;
+  for (int i = 0; i < kNumTimeBins; i++) {
+    energy += samples[i] * samples[i];
+    if (samples[i] > samples[highest]) {
+      highest = i;
+    }
+  }
+  if (energy <= 0.f || samples[highest] <= 0.f) {
+    return result;
+  }
+
+  // Coarse pass, the peak is within about a bin of the highest sample
+  const int center = static_cast<int>(highest * kBinWidth / step_);
+  const int window = static_cast<int>(kSearchWindow / step_);
+  const int first = std::max(0, center - window);
+  const int last = std::min(numPoints_ - 1, center + window);
+  int best = first;
+  float bestDot = dot(samples, first);
+  for (int p = first + kCoarseStride; p <= last; p += kCoarseStride) {
+    const float d = dot(samples, p);
+    if (d > bestDot) {
+      bestDot = d;
+      best = p;
+    }
+  }
+
+  // Fine pass between the coarse neighbours
+  const int coarseBest = best;
+  for (int p = std::max(0, coarseBest - kCoarseStride + 1); p < std::min(numPoints_, coarseBest + kCoarseStride);
+       p++) {
+    const float d = dot(samples, p);
+    if (d > bestDot) {
+      bestDot = d;
+      best = p;
+    }
+  }
+  if (bestDot <= 0.f) {
+    return result;
+  }
+
+  // Parabola through the best point and its neighbours
+  float offset = 0.f;
+  if (best > 0 && best < numPoints_ - 1) {
+    const float before = dot(samples, best - 1), after = dot(samples, best + 1);
+    const float curvature = before - 2.f * bestDot + after;
+    if (curvature < 0.f) {
+      offset = std::clamp(0.5f * (before - after) / curvature, -0.5f, 0.5f);
+    }
+  }
+
+  result.amplitude = bestDot / norm_[best];
+  result.peakTime = (best + offset) * step_;
+  result.quality = std::min(1.f, bestDot * bestDot / energy);
+  result.charge = result.amplitude * sum_[best];
+  return result;
+}
@@ -0,0 +1,122 @@
+// -*- C++ -*-
+//
+// Package:    MiniCSC/MiniCSC
+// Class:      CountHistogram
+//
+// Original Author:  Dylan Parks
+//
+//
+
+#include "MiniCSC/MiniCSC/interface/CountHistogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "FWCore/Utilities/interface/Exception.h"
+
+CountHistogramBase::CountHistogramBase(const char *name, const char *title, int nx, double xlow, double xup)
+    : name_(name), title_(title), nx_(nx), ny_(0), xlow_(xlow), xup_(xup), ylow_(0), yup_(0), counts_(nx + 2, 0) {}
+
+CountHistogramBase::CountHistogramBase(
+    const char *name, const char *title, int nx, double xlow, double xup, int ny, double ylow, double yup)
+    : name_(name),
+      title_(title),
+      nx_(nx),
+      ny_(ny),
+      xlow_(xlow),
+      xup_(xup),
+      ylow_(ylow),
+      yup_(yup),
+      counts_((nx + 2) * (ny + 2), 0) {}
+
+bool CountHistogramBase::inRange(int bin) const {
+  const int binx = bin % (nx_ + 2);
+  const int biny = bin / (nx_ + 2);
+  return binx >= 1 && binx <= nx_ && (ny_ == 0 || (biny >= 1 && biny <= ny_));
+}
+
+void CountHistogramBase::fill(int bin, double x, double y, double w) {
+  entries_++;
+  if (w == 1. && weights_.empty()) {
+    counts_[bin]++;
+  } else {
+    makeWeighted();
+    weights_[bin] += w;
+    sumw2_[bin] += w * w;
+  }
+  // Statistics as TH1::Fill/TH2::Fill keep them, under/overflow does not count
+  if (inRange(bin)) {
+    stats_[0] += w;
+    stats_[1] += w * w;
+    stats_[2] += w * x;
+    stats_[3] += w * x * x;
+    if (ny_ > 0) {
+      stats_[4] += w * y;
+      stats_[5] += w * y * y;
+      stats_[6] += w * x * y;
+    }
+  }
+}
+
+void CountHistogramBase::makeWeighted() {
+  if (!weights_.empty()) {
+    return;
+  }
+  // Every fill so far had weight 1
+  weights_.assign(counts_.begin(), counts_.end());
+  sumw2_ = weights_;
+  std::vector<uint32_t>().swap(counts_);
+}
+
+void CountHistogramBase::fillROOT(TH1 &hist) const {
+  if (isWeighted()) {
+    hist.Sumw2();
+    for (size_t bin = 0; bin < weights_.size(); bin++) {
+      hist.SetBinContent(bin, weights_[bin]);
+      hist.GetSumw2()->SetAt(sumw2_[bin], bin);
+    }
+  } else {
+    for (size_t bin = 0; bin < counts_.size(); bin++) {
+      hist.SetBinContent(bin, counts_[bin]);
+    }
+  }
+  // SetBinContent resets the statistics, so they go in last
+  double stats[TH1::kNstat] = {};
+  std::copy(std::begin(stats_), std::end(stats_), stats);
+  hist.PutStats(stats);
+  hist.SetEntries(entries_);
+}
+
+void CountHistogramBase::add(const TH1 &hist) {
+  const size_t numCells = isWeighted() ? weights_.size() : counts_.size();
+  if (static_cast<size_t>(hist.GetNcells()) != numCells) {
+    throw cms::Exception("LogicError") << "CountHistogram: " << hist.GetName() << " has " << hist.GetNcells()
+                                       << " bins, " << name_ << " has " << numCells;
+  }
+  // Anything that is not a whole count keeps its weights
+  bool counts = !isWeighted();
+  for (size_t bin = 0; counts && bin < numCells; bin++) {
+    const double content = hist.GetBinContent(bin);
+    counts = content >= 0 && content == std::floor(content) &&
+             (hist.GetSumw2N() == 0 || hist.GetSumw2()->At(bin) == content);
+  }
+  if (!counts) {
+    makeWeighted();
+  }
+  for (size_t bin = 0; bin < numCells; bin++) {
+    const double content = hist.GetBinContent(bin);
+    if (counts) {
+      counts_[bin] += static_cast<uint32_t>(content);
+    } else {
+      weights_[bin] += content;
+      sumw2_[bin] += hist.GetSumw2N() ? hist.GetSumw2()->At(bin) : content;
+    }
+  }
+
+  double stats[TH1::kNstat] = {};
+  hist.GetStats(stats);
+  for (int i = 0; i < 7; i++) {
+    stats_[i] += stats[i];
+  }
+  entries_ += hist.GetEntries();
+}
@@ -0,0 +1,342 @@
+// -*- C++ -*-
+//
+// Package:    MiniCSC/MiniCSC
+// Class:      MiniCSCArchive
+//
+// Original Author:  Dylan Parks
+//
+//
+
+#include "MiniCSC/MiniCSC/interface/MiniCSCArchive.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <lz4.h>
+#include <zlib.h>
+#include <zstd.h>
+
+#include "FWCore/Utilities/interface/Exception.h"
+
+namespace minicscarchive {
+
+  namespace {
+    /// pread the whole range or throw
+    void readAt(int fd, void *out, size_t bytes, uint64_t offset, const std::string &path) {
+      char *dst = static_cast<char *>(out);
+      while (bytes > 0) {
+        const ssize_t n = pread(fd, dst, bytes, offset);
+        if (n < 0 && errno == EINTR) {
+          continue;
+        }
+        if (n <= 0) {
+          throw cms::Exception("FileReadError") << "MiniCSCArchive: short read in " << path;
+        }
+        dst += n;
+        bytes -= n;
+        offset += n;
+      }
+    }
+
+    uint32_t checksum(const void *data, size_t bytes) {
+      return crc32(crc32(0L, Z_NULL, 0), static_cast<const Bytef *>(data), bytes);
+    }
+  }  // namespace
+
+  bool isArchive(const std::string &path) {
+    const size_t n = strlen(kExtension);
+    return path.size() >= n && path.compare(path.size() - n, n, kExtension) == 0;
+  }
+
+  // Writer =========================================================
+
+  Writer::Writer(const std::string &path, Compression compression, int level, size_t blockBytes, unsigned int numThreads)
+      : out_(path, std::ios::binary | std::ios::trunc),
+        compression_(compression),
+        level_(level),
+        blockWords_(std::max<size_t>(blockBytes / 8, 1)),
+        numThreads_(std::max(numThreads, 1u)) {
+    if (!out_) {
+      throw cms::Exception("FileOpenError") << "MiniCSCArchive: cannot create " << path;
+    }
+    const FileHeader header{kFileMagic, kVersion, compression_, 0};
+    out_.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  }
+
+  Writer::~Writer() {
+    // Call close() to see errors, here they can only be swallowed
+    if (!closed_) {
+      try {
+        close();
+      } catch (...) {
+      }
+    }
+  }
+
+  void Writer::add(const uint16_t *event, size_t words) {
+    if (words % 4 != 0) {
+      throw cms::Exception("LogicError") << "MiniCSCArchive: event of " << words << " words is not 64-bit aligned";
+    }
+    const uint64_t *begin = reinterpret_cast<const uint64_t *>(event);
+    pending_.insert(pending_.end(), begin, begin + words / 4);
+    pendingLengths_.push_back(words / 4);
+    numEvents_++;
+    if (pending_.size() >= blockWords_) {
+      flush();
+    }
+  }
+
+  void Writer::flush() {
+    if (pendingLengths_.empty()) {
+      return;
+    }
+    inflight_.push_back(std::async(std::launch::async,
+                                   &Writer::compress,
+                                   compression_,
+                                   level_,
+                                   blockFirstEvent_,
+                                   std::move(pending_),
+                                   std::move(pendingLengths_)));
+    blockFirstEvent_ = numEvents_;
+    pending_.clear();
+    pendingLengths_.clear();
+    pending_.reserve(blockWords_ + blockWords_ / 4);
+    // Blocks go to the file in order, only the compression runs ahead
+    while (inflight_.size() >= numThreads_) {
+      write(inflight_.front().get());
+      inflight_.pop_front();
+    }
+  }
+
+  Writer::Block Writer::compress(Compression compression,
+                                 int level,
+                                 uint64_t firstEvent,
+                                 std::vector<uint64_t> events,
+                                 std::vector<uint32_t> lengths) {
+    Block block;
+    const size_t rawBytes = events.size() * 8;
+    if (compression == kZstd) {
+      block.data.resize(ZSTD_compressBound(rawBytes));
+      const size_t n = ZSTD_compress(block.data.data(), block.data.size(), events.data(), rawBytes, level);
+      if (ZSTD_isError(n)) {
+        throw cms::Exception("LogicError") << "MiniCSCArchive: zstd failed: " << ZSTD_getErrorName(n);
+      }
+      block.data.resize(n);
+    } else {
+      block.data.resize(LZ4_compressBound(rawBytes));
+      const int n = LZ4_compress_default(reinterpret_cast<const char *>(events.data()),
+                                         block.data.data(),
+                                         static_cast<int>(rawBytes),
+                                         static_cast<int>(block.data.size()));
+      if (n <= 0) {
+        throw cms::Exception("LogicError") << "MiniCSCArchive: lz4 failed";
+      }
+      block.data.resize(n);
+    }
+    block.header = BlockHeader{static_cast<uint32_t>(block.data.size()),
+                               static_cast<uint32_t>(rawBytes),
+                               static_cast<uint32_t>(lengths.size()),
+                               checksum(events.data(), rawBytes),
+                               firstEvent};
+    block.lengths = std::move(lengths);
+    return block;
+  }
+
+  void Writer::write(Block block) {
+    directory_.push_back(BlockEntry{
+        static_cast<uint64_t>(out_.tellp()), block.header.firstEvent, block.header.numEvents, 0});
+    out_.write(reinterpret_cast<const char *>(&block.header), sizeof(block.header));
+    out_.write(reinterpret_cast<const char *>(block.lengths.data()), block.lengths.size() * sizeof(uint32_t));
+    out_.write(block.data.data(), block.data.size());
+    rawBytes_ += block.header.rawBytes;
+    compressedBytes_ += block.header.compressedBytes;
+  }
+
+  void Writer::close() {
+    flush();
+    while (!inflight_.empty()) {
+      write(inflight_.front().get());
+      inflight_.pop_front();
+    }
+    const FileTrailer trailer{static_cast<uint64_t>(out_.tellp()),
+                              numEvents_,
+                              static_cast<uint32_t>(directory_.size()),
+                              kIndexMagic};
+    out_.write(reinterpret_cast<const char *>(directory_.data()), directory_.size() * sizeof(BlockEntry));
+    out_.write(reinterpret_cast<const char *>(&trailer), sizeof(trailer));
+    out_.close();
+    closed_ = true;
+    if (!out_) {
+      throw cms::Exception("FileWriteError") << "MiniCSCArchive: write failed";
+    }
+  }
+
+  // Reader =========================================================
+
+  Reader::Reader(const std::vector<std::string> &files, unsigned int numThreads)
+      : numThreads_(std::max(numThreads, 1u)) {
+    for (const std::string &path : files) {
+      const int fd = open(path.c_str(), O_RDONLY);
+      if (fd < 0) {
+        throw cms::Exception("FileOpenError") << "MiniCSCArchive: cannot open " << path << ": " << strerror(errno);
+      }
+      archives_.push_back(Archive{fd, kZstd, path});
+      Archive &archive = archives_.back();
+
+      FileHeader header;
+      readAt(fd, &header, sizeof(header), 0, path);
+      if (header.magic != kFileMagic || header.version != kVersion) {
+        throw cms::Exception("FileReadError") << "MiniCSCArchive: " << path << " is not a version " << kVersion
+                                              << " archive";
+      }
+      if (header.compression != kZstd && header.compression != kLZ4) {
+        throw cms::Exception("FileReadError")
+            << "MiniCSCArchive: " << path << " has unknown compression " << header.compression;
+      }
+      archive.compression = static_cast<Compression>(header.compression);
+
+      const off_t size = lseek(fd, 0, SEEK_END);
+      FileTrailer trailer;
+      if (size < static_cast<off_t>(sizeof(header) + sizeof(trailer))) {
+        throw cms::Exception("FileReadError") << "MiniCSCArchive: " << path << " is truncated";
+      }
+      readAt(fd, &trailer, sizeof(trailer), size - sizeof(trailer), path);
+      if (trailer.magic != kIndexMagic) {
+        throw cms::Exception("FileReadError") << "MiniCSCArchive: " << path << " has no index (not closed?)";
+      }
+      // The directory sits right in front of the trailer, anything else is a corrupt or foreign file. Checked before
+      // the directory is allocated, so a bad trailer cannot ask for gigabytes.
+      const uint64_t directoryBytes = static_cast<uint64_t>(trailer.numBlocks) * sizeof(BlockEntry);
+      if (trailer.directoryOffset < sizeof(header) || trailer.directoryOffset > static_cast<uint64_t>(size) ||
+          trailer.directoryOffset + directoryBytes + sizeof(trailer) != static_cast<uint64_t>(size)) {
+        throw cms::Exception("FileReadError") << "MiniCSCArchive: " << path << " has a corrupt index";
+      }
+      std::vector<BlockEntry> directory(trailer.numBlocks);
+      readAt(fd, directory.data(), directoryBytes, trailer.directoryOffset, path);
+
+      for (const BlockEntry &entry : directory) {
+        if (entry.offset < sizeof(header) || entry.offset + sizeof(BlockHeader) > trailer.directoryOffset) {
+          throw cms::Exception("FileReadError") << "MiniCSCArchive: " << path << " has a block outside the file";
+        }
+        blocks_.emplace_back(archives_.size() - 1, entry);
+        blockFirst_.push_back(totalEvents_ + entry.firstEvent);
+      }
+      totalEvents_ += trailer.numEvents;
+    }
+    // Decoding starts with the first next()/skip(), info only needs the index
+  }
+
+  Reader::~Reader() {
+    // Futures from std::async wait for their task, so no decode still uses the fds below
+    window_.clear();
+    for (const Archive &archive : archives_) {
+      ::close(archive.fd);
+    }
+  }
+
+  void Reader::schedule() {
+    while (window_.size() < numThreads_ && nextBlock_ < blocks_.size()) {
+      window_.push_back(std::async(std::launch::async, &Reader::decode, this, nextBlock_++));
+    }
+  }
+
+  Reader::Decoded Reader::decode(size_t block) const {
+    const Archive &archive = archives_[blocks_[block].first];
+    const BlockEntry &entry = blocks_[block].second;
+
+    BlockHeader header;
+    readAt(archive.fd, &header, sizeof(header), entry.offset, archive.path);
+    Decoded decoded;
+    decoded.lengths.resize(header.numEvents);
+    readAt(archive.fd,
+           decoded.lengths.data(),
+           header.numEvents * sizeof(uint32_t),
+           entry.offset + sizeof(header),
+           archive.path);
+    std::vector<char> compressed(header.compressedBytes);
+    readAt(archive.fd,
+           compressed.data(),
+           compressed.size(),
+           entry.offset + sizeof(header) + header.numEvents * sizeof(uint32_t),
+           archive.path);
+
+    decoded.data.resize(header.rawBytes / 8);
+    bool ok;
+    if (archive.compression == kZstd) {
+      const size_t n = ZSTD_decompress(decoded.data.data(), header.rawBytes, compressed.data(), compressed.size());
+      ok = !ZSTD_isError(n) && n == header.rawBytes;
+    } else {
+      const int n = LZ4_decompress_safe(compressed.data(),
+                                        reinterpret_cast<char *>(decoded.data.data()),
+                                        static_cast<int>(compressed.size()),
+                                        static_cast<int>(header.rawBytes));
+      ok = n == static_cast<int>(header.rawBytes);
+    }
+    if (!ok || checksum(decoded.data.data(), header.rawBytes) != header.crc32) {
+      throw cms::Exception("FileReadError") << "MiniCSCArchive: corrupted block at offset " << entry.offset << " in "
+                                            << archive.path;
+    }
+    return decoded;
+  }
+
+  bool Reader::next(const uint16_t *&event, size_t &words) {
+    while (eventIndex_ >= current_.lengths.size()) {
+      if (window_.empty()) {
+        schedule();
+      }
+      if (window_.empty()) {
+        return false;
+      }
+      if (window_.front().wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        stalls_++;
+      }
+      current_ = window_.front().get();
+      window_.pop_front();
+      schedule();
+      eventIndex_ = 0;
+      offset_ = 0;
+    }
+    event = reinterpret_cast<const uint16_t *>(current_.data.data() + offset_);
+    words = current_.lengths[eventIndex_] * 4;
+    offset_ += current_.lengths[eventIndex_];
+    eventIndex_++;
+    return true;
+  }
+
+  void Reader::skip(uint64_t numEvents) {
+    // Position of the next event in the whole stream
+    uint64_t target = numEvents;
+    if (eventIndex_ < current_.lengths.size()) {
+      target += blockFirst_[nextBlock_ - window_.size() - 1] + eventIndex_;
+    } else if (nextBlock_ - window_.size() < blocks_.size()) {
+      target += blockFirst_[nextBlock_ - window_.size()];
+    } else {
+      return;
+    }
+    if (target >= totalEvents_) {
+      window_.clear();
+      nextBlock_ = blocks_.size();
+      current_ = Decoded();
+      eventIndex_ = 0;
+      return;
+    }
+
+    // Last block starting at or before the target
+    const size_t block = std::upper_bound(blockFirst_.begin(), blockFirst_.end(), target) - blockFirst_.begin() - 1;
+    window_.clear();
+    nextBlock_ = block;
+    current_ = Decoded();
+    eventIndex_ = 0;
+    schedule();
+
+    const uint16_t *event;
+    size_t words;
+    for (uint64_t i = blockFirst_[block]; i < target && next(event, words); i++) {
+    }
+  }
+
+}  // namespace minicscarchive
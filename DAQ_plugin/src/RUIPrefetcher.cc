@@ -0,0 +1,246 @@
+// -*- C++ -*-
+//
+// Package:    MiniCSC/MiniCSC
+// Class:      RUIPrefetcher
+//
+// Original Author:  Dylan Parks
+//
+//
+
+#include "MiniCSC/MiniCSC/interface/RUIPrefetcher.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "FWCore/MessageLogger/interface/MessageLogger.h"
+#include "FWCore/Utilities/interface/Exception.h"
+
+namespace {
+  constexpr size_t kPageBytes = 4096;
+
+  size_t roundUp(size_t value, size_t to) { return (value + to - 1) / to * to; }
+
+  /// DDU header 2, second 64-bit word of a DDU event (the first is the CDF header)
+  bool isDDUHeader2(uint64_t word) {
+    const uint16_t *w = reinterpret_cast<const uint16_t *>(&word);
+    return w[1] == 0x8000 && w[2] == 0x0001 && w[3] == 0x8000;
+  }
+
+  /// DDU trailer 1, followed by trailer 2 and the CDF trailer
+  bool isDDUTrailer1(uint64_t word) {
+    const uint16_t *w = reinterpret_cast<const uint16_t *>(&word);
+    return w[0] == 0x8000 && w[1] == 0x8000 && w[2] == 0xFFFF && w[3] == 0x8000;
+  }
+}  // namespace
+
+RUIPrefetcher::RUIPrefetcher(const std::vector<std::string> &files,
+                             size_t blockBytes,
+                             size_t maxEventBytes,
+                             unsigned int numBuffers,
+                             bool directIO)
+    : files_(files),
+      directIO_(directIO),
+      headroom_(roundUp(maxEventBytes, kPageBytes) / 8),
+      blockWords_(roundUp(blockBytes, kPageBytes) / 8),
+      buffers_(numBuffers < 2 ? 2 : numBuffers) {
+  for (const std::string &file : files_) {
+    if (access(file.c_str(), R_OK) != 0) {
+      throw cms::Exception("Configuration") << "RUIPrefetcher: cannot read " << file;
+    }
+  }
+  for (Buffer &buffer : buffers_) {
+    void *data = nullptr;
+    if (posix_memalign(&data, kPageBytes, (headroom_ + blockWords_) * 8) != 0) {
+      throw std::bad_alloc();
+    }
+    buffer.data = static_cast<uint64_t *>(data);
+    free_.push_back(&buffer);
+  }
+  thread_ = std::thread(&RUIPrefetcher::readLoop, this);
+}
+
+RUIPrefetcher::~RUIPrefetcher() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cond_.notify_all();
+  thread_.join();
+  for (Buffer &buffer : buffers_) {
+    free(buffer.data);
+  }
+}
+
+bool RUIPrefetcher::next(const uint16_t *&event, size_t &words) {
+  while (true) {
+    if (current_ != nullptr) {
+      if (eventIndex_ < current_->events.size()) {
+        const auto &ev = current_->events[eventIndex_++];
+        event = reinterpret_cast<const uint16_t *>(current_->data + ev.first);
+        words = ev.second * 4;
+        return true;
+      }
+      if (current_->last) {
+        return false;
+      }
+      // Done with this buffer, give it back to the reading thread
+      std::lock_guard<std::mutex> lock(mutex_);
+      free_.push_back(current_);
+      current_ = nullptr;
+      cond_.notify_all();
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (filled_.empty() && !error_) {
+      stalls_++;
+      cond_.wait(lock, [this] { return !filled_.empty() || error_; });
+    }
+    if (filled_.empty() && error_) {
+      std::rethrow_exception(error_);
+    }
+    current_ = filled_.front();
+    filled_.pop_front();
+    eventIndex_ = 0;
+  }
+}
+
+RUIPrefetcher::Buffer *RUIPrefetcher::takeFree() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cond_.wait(lock, [this] { return !free_.empty() || stop_; });
+  if (stop_) {
+    return nullptr;
+  }
+  Buffer *buffer = free_.front();
+  free_.pop_front();
+  return buffer;
+}
+
+void RUIPrefetcher::publish(Buffer *buffer) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    filled_.push_back(buffer);
+  }
+  cond_.notify_all();
+}
+
+size_t RUIPrefetcher::fill(int fd, Buffer &buffer) {
+  char *area = reinterpret_cast<char *>(buffer.data + headroom_);
+  const size_t bytes = blockWords_ * 8;
+  size_t done = 0;
+  while (done < bytes) {
+    const ssize_t n = read(fd, area + done, bytes - done);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw cms::Exception("FileReadError") << "RUIPrefetcher: read failed: " << strerror(errno);
+    }
+    if (n == 0) {
+      break;
+    }
+    done += n;
+  }
+  // RUI files are written in whole 64-bit words, a partial word can only be a truncated file
+  return done / 8;
+}
+
+size_t RUIPrefetcher::frame(Buffer &buffer) {
+  buffer.events.clear();
+  size_t start = buffer.end;  // start of the event being framed, end if none
+  for (size_t i = buffer.begin; i < buffer.end; i++) {
+    if (i > buffer.begin && isDDUHeader2(buffer.data[i])) {
+      if (start != buffer.end) {
+        dropped_++;  // header without trailer, FileReaderDDU drops these too
+      }
+      start = i - 1;
+    } else if (start != buffer.end && isDDUTrailer1(buffer.data[i])) {
+      if (i + 3 > buffer.end) {
+        break;  // trailer 2 and CDF trailer are in the next block
+      }
+      buffer.events.emplace_back(start, i + 3 - start);
+      start = buffer.end;
+      i += 2;
+    }
+  }
+  // Nothing open: still keep the last word, it may be the CDF header of an event whose header 2 is in the next block
+  if (start == buffer.end && buffer.end > buffer.begin) {
+    start = buffer.end - 1;
+  }
+  return start;
+}
+
+void RUIPrefetcher::readLoop() {
+  try {
+    for (size_t iFile = 0; iFile < files_.size(); iFile++) {
+      int flags = O_RDONLY;
+#ifdef O_DIRECT
+      if (directIO_) {
+        flags |= O_DIRECT;
+      }
+#endif
+      const int fd = open(files_[iFile].c_str(), flags);
+      if (fd < 0) {
+        throw cms::Exception("FileOpenError") << "RUIPrefetcher: cannot open " << files_[iFile] << ": "
+                                              << strerror(errno);
+      }
+      posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+      // Tail of the previous block: where it starts in prev and how long it is
+      Buffer *prev = nullptr;
+      size_t carryStart = 0, carryWords = 0;
+      while (true) {
+        Buffer *buffer = takeFree();
+        if (buffer == nullptr) {
+          close(fd);
+          return;
+        }
+        // Copy the unfinished event right in front of the read area. buffer can be prev itself once the consumer
+        // is done with it, hence memmove.
+        buffer->begin = headroom_ - carryWords;
+        if (carryWords > 0) {
+          memmove(buffer->data + buffer->begin, prev->data + carryStart, carryWords * 8);
+        }
+        const size_t words = fill(fd, *buffer);
+        buffer->end = headroom_ + words;
+        buffer->last = false;
+
+        const size_t tail = frame(*buffer);
+        carryStart = tail;
+        carryWords = buffer->end - tail;
+        if (carryWords > headroom_) {
+          edm::LogWarning("RUIPrefetcher") << "Dropping DDU event longer than maxEventBytes in " << files_[iFile];
+          dropped_++;
+          carryWords = 0;
+        }
+        publish(buffer);
+        prev = buffer;
+
+        if (words == 0) {
+          if (carryWords > 1) {
+            dropped_++;  // file ends in the middle of an event
+          }
+          break;
+        }
+      }
+      close(fd);
+    }
+
+    // Empty buffer flagged last ends the stream for next()
+    Buffer *buffer = takeFree();
+    if (buffer != nullptr) {
+      buffer->begin = buffer->end = headroom_;
+      buffer->events.clear();
+      buffer->last = true;
+      publish(buffer);
+    }
+  } catch (...) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      error_ = std::current_exception();
+    }
+    cond_.notify_all();
+  }
+}
@@ -11,6 +11,11 @@
      std::string if desired.
      I'm not sure vectors is the best method of data storage. On one hand it allows us to keep real layer numbers and
      vector indecies mostly the same. However, it prevents the use of iterators since there are null or empty graphs.
+     An instance owns its file and every graph it hands out, all of it is freed when the instance is destroyed, so a
+     loop creating one instance per run stays at constant memory. Graphs that should outlive the instance are copied
+     out with CopyGraph(). SetMaxOpenFiles() caps the files open across all instances, the least recently used ones
+     are closed first (their graphs are detached and kept) and opened again when needed. Not thread safe, like most of
+     ROOT's I/O.
 */
 //
 // Original Author:  Dylan Parks
@@ -18,16 +23,23 @@
 #ifndef MINICSCDATA_H_
 #define MINICSCDATA_H_
 
+#include <algorithm>
+#include <cmath>
 #include <cstdlib>
 #include <iostream>
+#include <list>
+#include <map>
+#include <memory>
 #include <sstream>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "TFile.h"
 #include "TH1.h"
 #include "TH2.h"
 #include "TProfile.h"
+#include "TProfile2D.h"
 
 /// @class MiniCSCData contains graph utilities for root files output by the MiniCSC CMSSW plugin.
 /// It does not do any data treatment, it is simply providing a common interface so that the EDM plugin can continue
@@ -53,39 +65,52 @@ public:
         kStripTBinADCVal, // TH2F, multi-layer, time bin firing occupancy per strip
         kStripOccupancy, // TH1D, multi-layer, strip occupancy (ADC>13) for a layer
         kHalfStripOccupancy, // TH1D, multi-layer, half-strip occupancy for a layer
-        kAveragePedestal, // TH1F, multi-layer, (WIP) average pedestal value for each ADC
-        kFirstPedestal, // TH1F, multi-layer, first sampled pedestal value
+        kAveragePedestal, // TH1F, multi-layer, (LEGACY) average pedestal value for each ADC, only in old outputs
+        kFirstPedestal, // TH1F, multi-layer, (LEGACY) first sampled pedestal value, only in old outputs
         kFiredStrip, // TH1F, all-layers, how many strips fire per event
         kChargeTBinProfile, // TProfile, all-layers, better representation of Graph::kChargeTBin,
         // shows time bin firing occupancy for all strips and layers
+        kStripMask, // TH1I, multi-layer, masked strips (1 = hot, 2 = dead)
+        kWireMask, // TH1I, multi-layer, masked wiregroups (1 = hot, 2 = dead)
+        kPulseTime, // TH1F, multi-layer, fitted pulse peak time of fired strips
+        kPulseQuality, // TH1F, all-layers, fraction of the strip signal explained by the pulse template
+        kGainMap, // TProfile2D, multi-layer, mean cluster charge per (strip, wiregroup) of matched clusters
+        kCoincidenceTimeDiff, // TH1F, all-layers, anode - cathode time in bx
+        kStripRate, // TProfile, multi-layer, dark rate per strip in Hz/cm^2
+        kWireRate, // TProfile, multi-layer, dark rate per wiregroup in Hz/cm^2
+        kLayerRate, // TProfile, all-layers, anode dark rate of each layer in Hz/cm^2
+        kLiveTime, // TH1D, all-layers, live time of the dark rate measurement in s (bin 1)
+        kInterEventTime, // TH1D, all-layers, log10 of the time between events in us
+        kOccupancyAfterHighTime, // TProfile, all-layers, fired strips vs log10(us) since a high charge signal
+        kOccupancyAfterLowTime, // TProfile, all-layers, fired strips vs log10(us) since a low charge signal
+        kOccupancyAfterHighEvents, // TProfile, all-layers, fired strips vs events since a high charge signal
+        kOccupancyAfterLowEvents, // TProfile, all-layers, fired strips vs events since a low charge signal
+        kPedestalSums, // TProfile, multi-layer, pedestal sum, sum of squares and count per strip
+        kFirstPedestalSums, // TProfile, multi-layer, first sampled pedestal per strip, summed over merged jobs
+        kCLCTPattern, // TH1I, multi-layer, CLCT pattern id
+        kCLCTBend, // TH1I, multi-layer, CLCT bend (0 = left, 1 = right)
         kLAST // Just for array sizing, no members should be placed after this
     };
 
     /// Number of layers in a miniCSC, should be 6 unless something very bad happened
     const uint16_t kNumLayers_ = 6;
 
-    /// Root file containing the graphs
-    TFile* rootFile_;
-
     /// Constructor
     /// @param rootFilePath full file path pointing to the root file
     /// @param nullableGraphs If true, changes graph getters to return a nullptr if a graph cannot be found.
     ///                       If false, not found graphs will be empty
     /// @param vectStartZero If true, graph getter vectors will start at zero, so to get a graph for a layer you would
     ///                      need to use layer - 1. If false, graph vectors will start at 1, aligning with miniCSC
-    MiniCSCData(const char* rootFilePath, bool nullableGraphs = true, bool vectStartZero = true)
-        : nullableGraphs_(nullableGraphs)
+    /// @param detachGraphs If true, graphs are detached from the file as they are read, so the file holds nothing in
+    ///                     memory and closing it (see SetMaxOpenFiles()) costs nothing. They still belong to this
+    ///                     instance either way.
+    MiniCSCData(
+        const char* rootFilePath, bool nullableGraphs = true, bool vectStartZero = true, bool detachGraphs = false)
+        : rootFilePath_(rootFilePath)
+        , nullableGraphs_(nullableGraphs)
         , vectStartZero_(vectStartZero)
+        , detachGraphs_(detachGraphs)
     {
-        // Allow other open options?
-        rootFile_ = new TFile(rootFilePath, "READ");
-
-        if (rootFile_->IsZombie()) {
-            std::cerr << "Root file " << rootFilePath
-                      << " was not opened properly. Please check that the file exists. Exiting program.\n";
-            std::exit(2);
-        }
-
         // Getting the file name from path for future utilities
         std::stringstream path(rootFilePath);
         std::string segment;
@@ -94,9 +119,10 @@ public:
         while (std::getline(path, segment, '/')) {
             seglist.push_back(segment);
         }
-        // NOTE: It appears root will free the strdup result at some point, when I tried to do it manually
-        //       the interpreter complained about duplicate freeing.
-        rootFileName_ = strdup(seglist.back().c_str());
+        rootFileName_ = seglist.empty() ? rootFilePath_ : seglist.back();
+
+        // Opens the file, exits if it cannot be read
+        file();
 
         // Getting anode graphs
         wireOccupancy_ = GetGraphs<TH1D>(Graph::kWireOccupancy);
@@ -105,19 +131,57 @@ public:
         firedWireGroup_ = GetGraph<TH1I>(Graph::kFiredWireGroup);
 
         // Getting cathode graphs
-        chargeSpectra_ = GetGraphs<TH1D>(Graph::kChargeSpectra);
         chargeTBin_ = GetGraphs<TH1D>(Graph::kChargeTBin);
         chargeTBinWeighted_ = GetGraphs<TH1D>(Graph::kChargeTBinWeighted);
         stripTBinADCVal_ = GetGraphs<TH2F>(Graph::kStripTBinADCVal);
         stripOccupancy_ = GetGraphs<TH1D>(Graph::kStripOccupancy);
         halfStripOccupancy_ = GetGraphs<TH1D>(Graph::kHalfStripOccupancy);
-        avgPedestal_ = GetGraphs<TH1F>(Graph::kAveragePedestal);
-        fstPedestal_ = GetGraphs<TH1F>(Graph::kFirstPedestal);
+        // Pedestals are stored as accumulators, the per strip views are derived from them here
+        pedestalSums_ = GetGraphs<TProfile>(Graph::kPedestalSums);
+        avgPedestal_ = pedestalViews(Graph::kPedestalSums, Graph::kAveragePedestal, PedestalView::kMean);
+        rmsPedestal_ = pedestalViews(Graph::kPedestalSums, Graph::kLAST, PedestalView::kRMS);
+        fstPedestal_ = pedestalViews(Graph::kFirstPedestalSums, Graph::kFirstPedestal, PedestalView::kFirst);
         firedStrip_ = GetGraph<TH1I>(Graph::kFiredStrip);
         chargeTBinProfile_ = GetGraph<TProfile>(Graph::kChargeTBinProfile);
+        pulseTime_ = GetGraphs<TH1F>(Graph::kPulseTime);
+        pulseQuality_ = GetGraph<TH1F>(Graph::kPulseQuality);
+
+        // Getting CLCT graphs
+        clctPattern_ = GetGraphs<TH1I>(Graph::kCLCTPattern);
+        clctBend_ = GetGraphs<TH1I>(Graph::kCLCTBend);
+
+        // Getting anode-cathode coincidence graphs
+        gainMap_ = GetGraphs<TProfile2D>(Graph::kGainMap);
+        coincidenceTimeDiff_ = GetGraph<TH1F>(Graph::kCoincidenceTimeDiff);
+
+        // Getting dark rate graphs
+        stripRate_ = GetGraphs<TProfile>(Graph::kStripRate);
+        wireRate_ = GetGraphs<TProfile>(Graph::kWireRate);
+        layerRate_ = GetGraph<TProfile>(Graph::kLayerRate);
+        liveTime_ = GetGraph<TH1D>(Graph::kLiveTime);
+
+        // Getting afterpulse graphs
+        interEventTime_ = GetGraph<TH1D>(Graph::kInterEventTime);
+        occupancyAfterHighTime_ = GetGraph<TProfile>(Graph::kOccupancyAfterHighTime);
+        occupancyAfterLowTime_ = GetGraph<TProfile>(Graph::kOccupancyAfterLowTime);
+        occupancyAfterHighEvents_ = GetGraph<TProfile>(Graph::kOccupancyAfterHighEvents);
+        occupancyAfterLowEvents_ = GetGraph<TProfile>(Graph::kOccupancyAfterLowEvents);
+
+        // Getting channel masks
+        stripMask_ = GetGraphs<TH1I>(Graph::kStripMask);
+        wireMask_ = GetGraphs<TH1I>(Graph::kWireMask);
+    }
+
+    /// Closes the file, which deletes the graphs still attached to it, and deletes the detached ones
+    ~MiniCSCData()
+    {
+        attached_.clear();
+        closeFile();
     }
 
-    // ~MiniCSCData() { std::free(rootFileName_); }
+    // Every graph pointer handed out belongs to exactly one instance
+    MiniCSCData(const MiniCSCData&) = delete;
+    MiniCSCData& operator=(const MiniCSCData&) = delete;
 
     // Anode Getters ===========================================================
 
@@ -132,8 +196,45 @@ public:
 
     // Cathode Getters =========================================================
 
-    /// Get graph of charge spectra on all strips per layer
-    std::vector<TH1D*> ChargeSpectra() const { return chargeSpectra_; }
+    /// Get graph of charge spectra on all strips per layer, at full resolution
+    std::vector<TH1D*> ChargeSpectra() const
+    {
+        // The largest graphs in the file, only read when asked for
+        if (chargeSpectra_.empty()) chargeSpectra_ = GetGraphs<TH1D>(Graph::kChargeSpectra);
+        return chargeSpectra_;
+    }
+    /// Get graph of charge spectra for one layer with rebin bins merged into one. Reads only the coarsest precomputed
+    /// level that divides rebin (/Cathode/chargeRebin<N>/, see chargePyramidLevels in MiniCSC) and rebins the rest,
+    /// outputs without the levels are rebinned from full resolution.
+    /// Asking again for the same layer and rebin returns the same histogram, it is made once per MiniCSCData.
+    /// @param layer MiniCSC layer, 1-6
+    /// @param rebin rebin factor, as for TH1::Rebin on the full resolution graph
+    TH1D* ChargeSpectra(uint16_t layer, int rebin) const
+    {
+        const auto cached = rebinnedChargeSpectra_.find({layer, rebin});
+        if (cached != rebinnedChargeSpectra_.end()) return cached->second;
+        TH1D*& result = rebinnedChargeSpectra_[{layer, rebin}];
+
+        TH1D* hist = nullptr;
+        int level = rebin;
+        for (; level > 1; level--) {
+            const std::string dir = "/Cathode/chargeRebin" + std::to_string(level);
+            if (rebin % level != 0 || !file()->GetDirectory(dir.c_str())) continue;
+            hist = getGraphObject<TH1D>(dir + "/chargeRebin" + std::to_string(level) + "L" + std::to_string(layer));
+            break;
+        }
+        if (level <= 1) {
+            level = 1;
+            hist = GetGraph<TH1D>(Graph::kChargeSpectra, layer);
+        }
+        // Empty placeholders (nullableGraphs off) have nothing to rebin
+        if (!hist || level >= rebin || hist->GetNbinsX() < rebin / level) return result = hist;
+
+        const std::string name = std::string(hist->GetName()) + "_rebin" + std::to_string(rebin);
+        TH1D* rebinned = static_cast<TH1D*>(hist->Rebin(rebin / level, name.c_str()));
+        keep(rebinned, false);
+        return result = rebinned;
+    }
     /// (GRAPH DEPRECIATED) Get graph of time bin firing occupancy for all strips
     std::vector<TH1D*> ChargeTBin() const { return chargeTBin_; }
     /// (GRAPH DEPRECIATED) Get graph of time bin firing occupancy weighted with the accumulated charge
@@ -144,14 +245,67 @@ public:
     std::vector<TH1D*> StripOccupancy() const { return stripOccupancy_; }
     /// Get graph of half-strip occupancy
     std::vector<TH1D*> HalfStripOccupancy() const { return halfStripOccupancy_; }
-    /// (GRAPH WIP) Get graph of average pedestal for each ADC
+    /// Get graph of average pedestal for each strip, error is the error of the mean
     std::vector<TH1F*> AveragePedestal() const { return avgPedestal_; }
-    /// Get graph of first sampled pedestal value for each ADC
+    /// Get graph of pedestal RMS for each strip
+    std::vector<TH1F*> PedestalRMS() const { return rmsPedestal_; }
+    /// Get graph of first sampled pedestal value for each strip, error is the distance from the nominal 1024
     std::vector<TH1F*> FirstPedestal() const { return fstPedestal_; }
+    /// Get the raw pedestal accumulators (sum, sum of squares and count per strip) the views above come from
+    std::vector<TProfile*> PedestalSums() const { return pedestalSums_; }
     /// Get graph of how many strips fire per event
     TH1I* FiredStrip() const { return firedStrip_; }
     /// Get graph of time bin firing occupancy for all strips and layers
     TProfile* ChargeTBinProfile() const { return chargeTBinProfile_; }
+    /// Get graph of the fitted pulse peak time (ns from time bin 0) of fired strips
+    std::vector<TH1F*> PulseTime() const { return pulseTime_; }
+    /// Get graph of the pulse template fit quality, 1 is a perfect fit
+    TH1F* PulseQuality() const { return pulseQuality_; }
+
+    // CLCT Getters ============================================================
+
+    /// Get graph of CLCT pattern ids, for trigger efficiency studies
+    std::vector<TH1I*> CLCTPattern() const { return clctPattern_; }
+    /// Get graph of CLCT bends, bin 1 left and bin 2 right
+    std::vector<TH1I*> CLCTBend() const { return clctBend_; }
+
+    // Coincidence Getters =====================================================
+
+    /// Get the mean cluster charge map (strip vs wiregroup) of matched anode and cathode clusters
+    std::vector<TProfile2D*> GainMap() const { return gainMap_; }
+    /// Get graph of the anode - cathode time difference, used to set the matching time offset
+    TH1F* CoincidenceTimeDiff() const { return coincidenceTimeDiff_; }
+
+    // Dark Rate Getters =======================================================
+
+    /// Get dark rate per strip (Hz/cm^2), only in outputs of dark rate mode jobs
+    std::vector<TProfile*> StripRate() const { return stripRate_; }
+    /// Get dark rate per wiregroup (Hz/cm^2)
+    std::vector<TProfile*> WireRate() const { return wireRate_; }
+    /// Get anode dark rate of each layer (Hz/cm^2)
+    TProfile* LayerRate() const { return layerRate_; }
+    /// Get live time in seconds, 0 if the file has none
+    double LiveTime() const { return liveTime_ ? liveTime_->GetBinContent(1) : 0.; }
+
+    // Afterpulse Getters ======================================================
+
+    /// Get graph of the time between consecutive events, log10(us)
+    TH1D* InterEventTime() const { return interEventTime_; }
+    /// Get graph of layer occupancy vs time since a high charge signal in that layer
+    TProfile* OccupancyAfterHighTime() const { return occupancyAfterHighTime_; }
+    /// Get graph of layer occupancy vs time since a low charge signal, reference for OccupancyAfterHighTime()
+    TProfile* OccupancyAfterLowTime() const { return occupancyAfterLowTime_; }
+    /// Get graph of layer occupancy vs number of events since a high charge signal in that layer
+    TProfile* OccupancyAfterHighEvents() const { return occupancyAfterHighEvents_; }
+    /// Get graph of layer occupancy vs number of events since a low charge signal
+    TProfile* OccupancyAfterLowEvents() const { return occupancyAfterLowEvents_; }
+
+    // Mask Getters ============================================================
+
+    /// Get strips masked during the run, bin content 1 for hot and 2 for dead strips
+    std::vector<TH1I*> StripMask() const { return stripMask_; }
+    /// Get wiregroups masked during the run, bin content 1 for hot and 2 for dead wiregroups
+    std::vector<TH1I*> WireMask() const { return wireMask_; }
 
     // Generic Getters =========================================================
 
@@ -160,7 +314,39 @@ public:
     /// Check if graph vectors start at zero or one when indexing layers
     const bool VectStartZero() const { return vectStartZero_; }
     /// Get root file name read at construction time
-    const char* RootFileName() const { return rootFileName_; }
+    const char* RootFileName() const { return rootFileName_.c_str(); }
+    /// Check if graphs are detached from the file as they are read
+    const bool DetachGraphs() const { return detachGraphs_; }
+    /// Get the root file containing the graphs, opened again if it was closed to stay within MaxOpenFiles()
+    TFile* RootFile() const { return file(); }
+
+    /// Copy of a graph that is not attached to any file and belongs to the caller, so it outlives this instance
+    /// @tparam T type of graph to find
+    /// @param name name of graph to find
+    /// @param layer MiniCSC layer that the graph represents, if it has one
+    /// @return the copy, null if the graph is not in the file
+    template <typename T> std::unique_ptr<T> CopyGraph(Graph name, uint16_t layer = kInvalidLayer_) const
+    {
+        T* graph = GetGraph<T>(name, layer);
+        if (!graph) return nullptr;
+        std::unique_ptr<T> copy(static_cast<T*>(graph->Clone()));
+        if (TH1* hist = dynamic_cast<TH1*>(static_cast<TObject*>(copy.get()))) hist->SetDirectory(nullptr);
+        return copy;
+    }
+
+    // Open File Limit ========================================================
+
+    /// Set how many files all MiniCSCData instances may keep open at once, 0 (the default) for no limit. Beyond it the
+    /// least recently used files are closed, after detaching their graphs.
+    static void SetMaxOpenFiles(size_t maxOpenFiles)
+    {
+        openFiles().maxOpen = maxOpenFiles;
+        enforceMaxOpenFiles();
+    }
+    /// Get the limit set with SetMaxOpenFiles()
+    static size_t MaxOpenFiles() { return openFiles().maxOpen; }
+    /// Get how many files the MiniCSCData instances have open
+    static size_t NumOpenFiles() { return openFiles().lru.size(); }
 
     /// Get Graph by name
     /// @tparam T type of graph to find
@@ -214,9 +400,31 @@ public:
 private:
     /// Value used to check for default layer numbers
     const static uint16_t kInvalidLayer_ = 0;
-    char* rootFileName_;
+    std::string rootFilePath_;
+    std::string rootFileName_;
     bool nullableGraphs_;
     bool vectStartZero_;
+    bool detachGraphs_;
+
+    /// Open files of all instances, most recently used first
+    struct OpenFiles {
+        size_t maxOpen = 0;
+        std::list<const MiniCSCData*> lru;
+    };
+    static OpenFiles& openFiles()
+    {
+        static OpenFiles files;
+        return files;
+    }
+
+    /// Root file containing the graphs, null while closed
+    mutable std::unique_ptr<TFile> rootFile_;
+    /// Position in openFiles().lru while the file is open
+    mutable std::list<const MiniCSCData*>::iterator lruPos_;
+    /// Graphs read from the file and still attached to it, the file deletes them when it closes
+    mutable std::vector<TH1*> attached_;
+    /// Everything else handed out: detached graphs, empty placeholders and the pedestal views
+    mutable std::vector<std::unique_ptr<TObject>> owned_;
 
     // Anode plots
     std::vector<TH1D*> wireOccupancy_;
@@ -225,16 +433,47 @@ private:
     TH1I* firedWireGroup_;
 
     // Cathode plots
-    std::vector<TH1D*> chargeSpectra_;
+    mutable std::vector<TH1D*> chargeSpectra_;
+    /// ChargeSpectra(layer, rebin) results by (layer, rebin), owned by owned_ or the file like every other graph
+    mutable std::map<std::pair<uint16_t, int>, TH1D*> rebinnedChargeSpectra_;
     std::vector<TH1D*> chargeTBin_;
     std::vector<TH1D*> chargeTBinWeighted_;
     std::vector<TH2F*> stripTBinADCVal_;
     std::vector<TH1D*> stripOccupancy_;
     std::vector<TH1D*> halfStripOccupancy_;
     std::vector<TH1F*> avgPedestal_;
+    std::vector<TH1F*> rmsPedestal_;
     std::vector<TH1F*> fstPedestal_;
+    std::vector<TProfile*> pedestalSums_;
     TH1I* firedStrip_;
     TProfile* chargeTBinProfile_;
+    std::vector<TH1F*> pulseTime_;
+    TH1F* pulseQuality_;
+
+    // CLCT plots
+    std::vector<TH1I*> clctPattern_;
+    std::vector<TH1I*> clctBend_;
+
+    // Coincidence plots
+    std::vector<TProfile2D*> gainMap_;
+    TH1F* coincidenceTimeDiff_;
+
+    // Dark rate plots
+    std::vector<TProfile*> stripRate_;
+    std::vector<TProfile*> wireRate_;
+    TProfile* layerRate_;
+    TH1D* liveTime_;
+
+    // Afterpulse plots
+    TH1D* interEventTime_;
+    TProfile* occupancyAfterHighTime_;
+    TProfile* occupancyAfterLowTime_;
+    TProfile* occupancyAfterHighEvents_;
+    TProfile* occupancyAfterLowEvents_;
+
+    // Mask plots
+    std::vector<TH1I*> stripMask_;
+    std::vector<TH1I*> wireMask_;
 
     /// Array containing root file paths for each graph. Index in MiniCSCData::Graph should be the same as desired path
     /// in this array
@@ -243,7 +482,70 @@ private:
               "/Anode/firedWireGroup", "/Cathode/charge/chargeL", "/Cathode/chargeTBin/chargeTBinL",
               "Cathode/chargeTBinWeighted/chargeTBinWeightedL", "/Cathode/stripTBinADCVal/stripTBinADCValL",
               "/Cathode/strip/stripL", "/Cathode/halfStrip/halfStripL", "/Cathode/avgPedestal/avgPedestalL",
-              "/Cathode/fstPedestal/fstPedestalL", "/Cathode/firedStrip", "/Cathode/chargeTBinProfile" };
+              "/Cathode/fstPedestal/fstPedestalL", "/Cathode/firedStrip", "/Cathode/chargeTBinProfile",
+              "/Mask/stripMaskL", "/Mask/wireMaskL", "/Cathode/pulseTime/pulseTimeL", "/Cathode/pulseQuality",
+              "/Coincidence/gainMap/gainMapL", "/Coincidence/coincidenceTimeDiff", "/DarkRate/stripRate/stripRateL",
+              "/DarkRate/wireRate/wireRateL", "/DarkRate/layerRate", "/DarkRate/liveTime", "/Afterpulse/interEventTime",
+              "/Afterpulse/occupancyAfterHighTime", "/Afterpulse/occupancyAfterLowTime",
+              "/Afterpulse/occupancyAfterHighEvents", "/Afterpulse/occupancyAfterLowEvents", "/Cathode/pedestal/pedestalL",
+              "/Cathode/firstPedestal/firstPedestalL", "/CLCT/pattern/clctPatternL", "/CLCT/bend/clctBendL" };
+
+    /// What a pedestal view shows for each strip
+    enum class PedestalView { kMean, kRMS, kFirst };
+
+    /// Builds the per strip pedestal graphs for each layer from the accumulators.
+    /// @param legacy graph to read instead for outputs written before the accumulators, Graph::kLAST if there is none
+    std::vector<TH1F*> pedestalViews(Graph accumulator, Graph legacy, PedestalView view) const
+    {
+        std::vector<TH1F*> vect;
+        if (!vectStartZero_) {
+            vect.push_back(nullptr);
+        }
+        for (uint16_t layer = 1; layer < kNumLayers_ + 1; layer++) {
+            TProfile* sums = nullptr;
+            file()->GetObject(getGraphFullPath(accumulator, layer).c_str(), sums);
+            if (sums) {
+                keep(sums, !detachGraphs_);
+                vect.push_back(pedestalView(sums, view));
+                keep(vect.back(), false);
+            } else if (legacy != Graph::kLAST) {
+                vect.push_back(GetGraph<TH1F>(legacy, layer));
+            } else if (nullableGraphs_) {
+                vect.push_back(nullptr);
+            } else {
+                vect.push_back(new TH1F());
+                keep(vect.back(), false);
+            }
+        }
+        return vect;
+    }
+
+    /// One layer's pedestal view. Mean and RMS come from the sums, the first pedestal keeps the old error convention
+    /// (1024 - value).
+    static TH1F* pedestalView(const TProfile* sums, PedestalView view)
+    {
+        const char* suffix = view == PedestalView::kMean ? "_mean" : view == PedestalView::kRMS ? "_rms" : "_first";
+        const int numBins = sums->GetNbinsX();
+        TH1F* hist = new TH1F((std::string(sums->GetName()) + suffix).c_str(), sums->GetTitle(), numBins,
+            sums->GetXaxis()->GetXmin(), sums->GetXaxis()->GetXmax());
+        hist->SetDirectory(nullptr);
+        for (int bin = 1; bin <= numBins; bin++) {
+            const double count = sums->GetBinEntries(bin);
+            if (count <= 0) continue;
+            const double mean = sums->GetBinContent(bin);
+            if (view == PedestalView::kMean) {
+                hist->SetBinContent(bin, mean);
+                hist->SetBinError(bin, sums->GetBinError(bin));
+            } else if (view == PedestalView::kRMS) {
+                const double meanSquare = (*sums->GetSumw2())[bin] / count;
+                hist->SetBinContent(bin, std::sqrt(std::max(0., meanSquare - mean * mean)));
+            } else {
+                hist->SetBinContent(bin, mean);
+                hist->SetBinError(bin, 1024 - mean);
+            }
+        }
+        return hist;
+    }
 
     /// Generates full path by adding layer number to end of string from graphPaths if it is a valid
     /// layer number.
@@ -258,11 +560,73 @@ private:
     template <typename T> T* getGraphObject(std::string path) const
     {
         T* hist = nullptr;
-        rootFile_->GetObject(path.c_str(), hist);
-        if (!hist && !nullableGraphs_) hist = new T();
+        file()->GetObject(path.c_str(), hist);
+        if (hist) {
+            keep(hist, !detachGraphs_);
+        } else if (!nullableGraphs_) {
+            hist = new T();
+            keep(hist, false);
+        }
 
         return hist;
     }
+
+    /// Takes ownership of obj. Histograms stay attached to the file if attach is set, anything else is owned directly.
+    void keep(TObject* obj, bool attach) const
+    {
+        TH1* hist = dynamic_cast<TH1*>(obj);
+        if (hist && attach) {
+            // Reading a graph again returns the one already in memory
+            if (std::find(attached_.begin(), attached_.end(), hist) == attached_.end()) attached_.push_back(hist);
+            return;
+        }
+        if (hist) hist->SetDirectory(nullptr);
+        owned_.emplace_back(obj);
+    }
+
+    /// The root file, opened again if it was closed. Marks it as the most recently used one.
+    TFile* file() const
+    {
+        OpenFiles& files = openFiles();
+        if (rootFile_) {
+            files.lru.splice(files.lru.begin(), files.lru, lruPos_);
+            return rootFile_.get();
+        }
+
+        rootFile_.reset(TFile::Open(rootFilePath_.c_str(), "READ"));
+        if (!rootFile_ || rootFile_->IsZombie()) {
+            std::cerr << "Root file " << rootFilePath_
+                      << " was not opened properly. Please check that the file exists. Exiting program.\n";
+            std::exit(2);
+        }
+        files.lru.push_front(this);
+        lruPos_ = files.lru.begin();
+        enforceMaxOpenFiles();
+        return rootFile_.get();
+    }
+
+    /// Closes the file, graphs still attached to it are detached first so they stay valid
+    void closeFile() const
+    {
+        if (!rootFile_) return;
+        for (TH1* hist : attached_) {
+            hist->SetDirectory(nullptr);
+            owned_.emplace_back(hist);
+        }
+        attached_.clear();
+        rootFile_->Close();
+        rootFile_.reset();
+        openFiles().lru.erase(lruPos_);
+    }
+
+    /// Closes the least recently used files until the limit is met, the most recent one always stays open
+    static void enforceMaxOpenFiles()
+    {
+        OpenFiles& files = openFiles();
+        while (files.maxOpen > 0 && files.lru.size() > files.maxOpen) {
+            files.lru.back()->closeFile();
+        }
+    }
 };
 
 #endif // MINICSCDATA_H_
@@ -4,6 +4,8 @@
 // You can run this example using `root MiniCSCDataExample.cpp`. Unfortunately due to root's interpreter and memory
 // managment practices, you cannot use the `.x` execute function more than once. To get around this you must quit each
 // time you restart the macro (this is mainly because of the header file, YMMV).
+// The compiled library (see CMakeLists.txt) does not have this problem: with libMiniCSCMacros loaded, call
+// `MiniCSCDataExample()` at the ROOT prompt as often as you like.
 //
 // This tutorial assumes you are using the MiniCSC.cc plugin found here:
 // https://github.com/shanepack/miniCSC/blob/main/plugins/MiniCSC.cc
@@ -15,6 +17,7 @@
 
 // Include required headers
 #include "MiniCSCData.h"
+#include "MiniCSCMacros.h"
 
 // Define the root macro, notice the function name is the same as the file name
 void MiniCSCDataExample()
@@ -60,6 +63,8 @@ void MiniCSCDataExample()
     // first.
 
     // First we rebin, making each bin (x axis tick) wider. This removes some noise and makes it overall more readable.
+    // NOTE: data.ChargeSpectra(3, 32) gives the same graph already rebinned, and only reads that graph from the file
+    //       if MiniCSC wrote the precomputed levels. Prefer it when comparing many runs.
     chargeSpectraL3->Rebin(32);
     // Then we chop off the first 100 bins, this is because there is a large spike which is most likely noise at the
     // beginning. The upper bound of 4000.5 removes the tail at the end of the graph which does not have much useful
@@ -70,8 +75,9 @@ void MiniCSCDataExample()
     // presenting the plots.
     chargeSpectraL3->SetTitle("Charge Spectra");
 
-    // Finally we draw
-    chargeSpectraL3->Draw();
+    // Finally we draw. The graphs belong to `data` and are deleted with it at the end of this function, which would
+    // clear the canvas too, so we draw a copy that belongs to the canvas instead.
+    chargeSpectraL3->DrawCopy();
 
     // Now that we've covered the basics, I will explain some more niche functionality. Theoretically you shouldn't need
     // to use this if future plots are created properly.
@@ -87,4 +93,14 @@ void MiniCSCDataExample()
     // on your editor of choice, hovering over the name should show you the comment for quick reference.
     TProfile* chargeTBin = data.GetGraph<TProfile>(MiniCSCData::Graph::kChargeTBinProfile);
     // chargeTBin->Draw();
+
+    // Looping over many runs =========================================================================================
+    // Each MiniCSCData closes its file and frees its graphs when destroyed, so creating one per run inside a loop keeps
+    // memory constant. Copy out (CopyGraph) whatever should survive the iteration. If the instances are kept around
+    // instead, e.g. to compare runs at the end, cap the open files and let the least recently used ones be closed.
+    // Detached graphs make closing a file free:
+    //
+    //     MiniCSCData::SetMaxOpenFiles(64);
+    //     std::vector<std::unique_ptr<MiniCSCData>> runs;
+    //     for (const char* path : paths) runs.emplace_back(new MiniCSCData(path, true, true, true));
 }
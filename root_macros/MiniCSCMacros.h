@@ -0,0 +1,50 @@
+// -*- C++ -*-
+//
+// Library:    MiniCSCMacros
+//
+/**\file MiniCSCMacros.h
+
+ Description: Entry points of the macros built into libMiniCSCMacros
+
+ Implementation:
+     Each macro still defines its function in its own .cpp file, so `root chargeFit.cpp` works as before. The default
+     arguments live here and not in the .cpp files, and every macro includes this header, so the interpreted and the
+     compiled versions take the same arguments.
+     The library's dictionary covers MiniCSCData and these functions. Once the library is loaded (or found through its
+     rootmap), calling them at the ROOT prompt runs compiled code and does not parse MiniCSCData.h again.
+*/
+//
+// Original Author:  Dylan Parks
+//
+#ifndef MINICSCMACROS_H_
+#define MINICSCMACROS_H_
+
+class TF1;
+
+/// Fits one or two gaussians to the charge spectrum of one layer and draws it
+/// @param rootFile MiniCSC output file
+/// @param layer layer to fit, 1-6
+/// @param rebin rebin factor for the charge spectrum
+/// @param outputFile if set, the plot is saved to this file (.pdf, .png, ...)
+/// @return the summed fit, or nullptr if the layer has no charge spectrum. It and the fitted histogram stay valid
+///         until the next call.
+TF1* chargeFit(const char* rootFile = "./r78_thres32.root", int layer = 3, int rebin = 32,
+    const char* outputFile = nullptr);
+
+/// Draws the layer 3 cluster charge of every root file in a directory on one canvas
+/// @param inputDir directory with the MiniCSC output files
+/// @param outputFile where the canvas is saved
+/// @param rebinFactor rebin factor for every histogram, 32 is close to the DQM plots, 1 disables rebinning
+void clusterChargeRebin(const char* inputDir = "../../rootfiles",
+    const char* outputFile = "../../outputs/clusterCharge.pdf", int rebinFactor = 32);
+
+/// Merges the MiniCSC outputs listed in fileList into outputFile
+/// @param outputFile merged root file, overwritten
+/// @param fileList text file with one input root file per line
+/// @param numThreads threads reading and adding the inputs
+void mergeMiniCSC(const char* outputFile, const char* fileList, int numThreads = 4);
+
+/// Walkthrough of MiniCSCData, see MiniCSCDataExample.cpp
+void MiniCSCDataExample();
+
+#endif
@@ -0,0 +1,15 @@
+// Dictionary contents of libMiniCSCMacros, see CMakeLists.txt
+
+#ifdef __CLING__
+#pragma link off all globals;
+#pragma link off all classes;
+#pragma link off all functions;
+
+#pragma link C++ class MiniCSCData;
+#pragma link C++ enum MiniCSCData::Graph;
+
+#pragma link C++ function chargeFit;
+#pragma link C++ function clusterChargeRebin;
+#pragma link C++ function mergeMiniCSC;
+#pragma link C++ function MiniCSCDataExample;
+#endif
@@ -1,4 +1,5 @@
 #include "MiniCSCData.h"
+#include "MiniCSCMacros.h"
 #include <Fit/BinData.h>
 #include <Fit/FitData.h>
 #include <Fit/Fitter.h>
@@ -7,8 +8,10 @@
 #include <RtypesCore.h>
 #include <TF1.h>
 #include <TH1.h>
+#include <TVirtualPad.h>
 #include <TStyle.h>
 #include <iostream>
+#include <memory>
 
 /// minimum x value for peak1, also acts as lower bound for summed fit, just give it a good guess
 static const size_t peak1_min = 800;
@@ -21,26 +24,37 @@ static const size_t peak2_max = 8000;
 /// true if cadmium (has two peaks)
 static const bool two_peaks = true;
 
-/// Use this to fit a charge spectra
-void chargeFit()
+/// Use this to fit a charge spectra, the arguments are documented in MiniCSCMacros.h
+TF1* chargeFit(const char* rootFile, int layer, int rebin, const char* outputFile)
 {
-    MiniCSCData mdata("./r78_thres32.root");
+    MiniCSCData mdata(rootFile);
 
-    TH1D* chg = mdata.ChargeSpectra()[2];
-    chg->Rebin(32);
+    // Reads the precomputed rebinned spectrum when the file has it
+    TH1D* rebinned = mdata.ChargeSpectra(layer, rebin);
+    if (!rebinned) {
+        std::cerr << "No charge spectrum for layer " << layer << " in " << rootFile << std::endl;
+        return nullptr;
+    }
+    // Copied out so the plot outlives the file, the previous call's spectrum and fits are freed here
+    static std::unique_ptr<TH1D> spectrum;
+    spectrum.reset(static_cast<TH1D*>(rebinned->Clone()));
+    spectrum->SetDirectory(nullptr);
+    TH1D* chg = spectrum.get();
     chg->SetFillColor(38);
 
     // Define the parameter array for the total function.
     double par[9];
 
-    // Three TF1 objects are created, one for each subrange.
-    TF1* g1 = new TF1("g1", "gaus", peak1_min, peak1_max);
+    // Three TF1 objects are created, one for each subrange. Kept like the spectrum and freed by the next call, ROOT
+    // only drops a function of the same name from its list and never deletes it.
+    static std::unique_ptr<TF1> g1, g2, total;
+    g1.reset(new TF1("g1", "gaus", peak1_min, peak1_max));
     g1->SetLineWidth(3);
-    TF1* g2 = new TF1("g2", "gaus", peak2_min, peak2_max);
+    g2.reset(new TF1("g2", "gaus", peak2_min, peak2_max));
     g2->SetLineWidth(3);
 
     // The total is the sum of the three, each has three parameters.
-    TF1* total = new TF1("total", "gaus(0)+gaus(3)", peak1_min, peak2_max);
+    total.reset(new TF1("total", "gaus(0)+gaus(3)", peak1_min, peak2_max));
     total->SetLineColor(2);
     total->SetLineWidth(3);
 
@@ -51,8 +65,8 @@ void chargeFit()
     // can also specify the range in the call to TH1::Fit(), which we demonstrate
     // here with the 3rd Gaussian. The "+" option needs to be added to the later
     // fits to not replace existing fitted functions in the histogram.
-    chg->Fit(g1, "R");
-    if (two_peaks) chg->Fit(g2, "R+");
+    chg->Fit(g1.get(), "R");
+    if (two_peaks) chg->Fit(g2.get(), "R+");
 
     // Get the parameters from the fit.
     g1->GetParameters(&par[0]);
@@ -60,8 +74,10 @@ void chargeFit()
 
     // Use the parameters on the sum.
     total->SetParameters(par);
-    chg->Fit(total, "R");
+    chg->Fit(total.get(), "R");
     gStyle->SetOptFit(1111);
     chg->Draw();
     chg->GetXaxis()->SetRangeUser(0.5, 10000.5);
+    if (outputFile) gPad->SaveAs(outputFile);
+    return total.get();
 }
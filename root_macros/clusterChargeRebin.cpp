@@ -8,24 +8,23 @@
 #include <TSystemDirectory.h>
 #include <TSystemFile.h>
 #include <iostream>
+#include <memory>
 #include <vector>
 
 #include "MiniCSCData.h" // MiniCSCData.h object to read the root file, true for null pointer, false for blank graphs
+#include "MiniCSCMacros.h"
 
 //?================================================================================================================================================================
 //? 1. The clusterChargeRebin function reads all root files in a defined directory and extracts the cluster charge histograms from them.
 //? 2. Then, the function rebins the cluster charge histograms and displays them on the same canvas, alongside a Gaussian fit for each histogram.
 //? 3. The histograms & Gaussian fits are colored differently to distinguish them from each other.
-//? 4. The histograms are saved as a PDF file in the outputs folder, which can be used to compare the cluster charge distributions.
+//? 4. The histograms are saved as a PDF file (outputFile), which can be used to compare the cluster charge distributions.
+//? The input directory, output file and rebin factor are arguments, their defaults are in MiniCSCMacros.h.
 //?================================================================================================================================================================
 
 using namespace std;
 
-//Change this value to rebin the histograms by a different factor (32 is close to DQM plots)
-//! Set to 1 to disable rebinning.
-int rebinFactor = 32;
-
-void clusterChargeRebin()
+void clusterChargeRebin(const char* inputDir, const char* outputFile, int rebinFactor)
 {
     // Disable default stats
     gStyle->SetOptStat(0);
@@ -38,11 +37,12 @@ void clusterChargeRebin()
     int colorCounter = 0;
     // Used to store the maximum value of the histograms for the y-axis range.
     int prevMax = 0;
+    // The drawn histograms, copied out of each file so the file can be closed before the next one is read.
+    std::vector<std::unique_ptr<TH1D>> hists;
 
     //?--------------------------------------Read Root File's Cluster Charge Graphs--------------------------------------
 
-    //! NOTE: Replace with your own path to root files.
-    TSystemDirectory dir("rootfiles", "../../rootfiles");
+    TSystemDirectory dir("rootfiles", inputDir);
     TList* files = dir.GetListOfFiles();
     files->Sort();
     if (files) {
@@ -53,8 +53,7 @@ void clusterChargeRebin()
             fname = file->GetName();
             if (!file->IsDirectory() && fname.EndsWith(".root")) {
 
-                //! NOTE: Replace with your own path to root files.
-                TString filePath = TString::Format("../../rootfiles/%s", fname.Data());
+                TString filePath = TString::Format("%s/%s", inputDir, fname.Data());
 
                 // MiniCSCData.h object to read the root file.
                 // 1st False for blank histograms (Change to true for null pointer if histogram is not found.)
@@ -62,21 +61,26 @@ void clusterChargeRebin()
                 MiniCSCData myFile(filePath, false, true);
 
                 // MiniCSCData.h object to define which histogram(s) to read, and what layer to read from.
-                // If MiniCSCData's vectStartZero is enabled, the layer number is 1 less than the layer you want to read.
-                TH1D* hist = (myFile.ChargeSpectra()[2]);
+                // The layer number is the real one (1-6) here, vectStartZero only shifts the vector getters.
+                // ChargeSpectra(layer, rebin) reads the precomputed rebinned spectrum when the file has one.
+                //!NOTE: Rebin DIVIDES the number of bins by rebinFactor. (32 is close to DQM plots)
+                TH1D* layerHist = myFile.ChargeSpectra(3, rebinFactor);
 
                 //*OPTIONAL: Use 'GetGraph' if you need a specific graph/to read something without a getter (this ^)
-                //*OPTIONAL: hist = myFile.GetGraph<TH1D>(MiniCSCData::Graph::kChargeSpectra, 3);
+                //*OPTIONAL: layerHist = myFile.GetGraph<TH1D>(MiniCSCData::Graph::kChargeSpectra, 3);
+
+                if (!layerHist) continue; // Skip if histogram is not found
 
-                if (!hist) continue; // Skip if histogram is not found
+                // Copied since myFile (and every graph it read) is freed at the end of this iteration.
+                hists.emplace_back(static_cast<TH1D*>(layerHist->Clone()));
+                TH1D* hist = hists.back().get();
+                hist->SetDirectory(nullptr);
 
                 //!NOTE: Change the title of the histogram here.
                 hist->SetTitle("Dark Rate: Premix, PD = 65 vs. Dynamic, PD = 66");
 
-                //?--------------------------------------Rebin Histograms--------------------------------------
+                //?--------------------------------------Style Histograms--------------------------------------
 
-                //!NOTE: Rebin DIVIDES by rebinFactor. (32 is close to DQM plots)
-                hist->Rebin(rebinFactor); // Rebin the histogram
                 hist->SetLineColor(colorCounter + 1); // Vary the line color
                 hist->SetFillColorAlpha(colorCounter + 1, 0.3); // Vary the fill color with opacity
 
@@ -127,6 +131,6 @@ void clusterChargeRebin()
 
     leg->Draw();
     canvas->Draw();
-    canvas->SaveAs("../../outputs/clusterCharge.pdf"); //! NOTE: Change to your designated path to save PDF files.
+    canvas->SaveAs(outputFile);
     canvas->Close(); // Close the canvas after saving the file
 }
\ No newline at end of file
@@ -0,0 +1,154 @@
+// Merges the root files of a run that was split over many MiniCSC jobs into one file.
+//
+// Every MiniCSC histogram is an accumulator (counts, sums, TProfiles), so merging is TH1::Add. The one exception is
+// /Mask/, where a channel masked by any job stays masked (largest flag wins). hadd gives the same result for
+// everything but the masks.
+//
+// The inputs are split over numThreads threads, each one adds its share into its own set of histograms, and the
+// partial sums are added at the end. Compile it, threads do not work in the interpreter:
+//
+//   root -l -b -q 'mergeMiniCSC.cpp+("merged.root", "chunks.txt", 8)'
+//
+// or use the prebuilt one (see CMakeLists.txt): miniCSCPlots merge -j 8 merged.root chunks.txt
+//
+// chunks.txt lists one MiniCSC output file per line, lines starting with # are skipped.
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TClass.h"
+#include "TDirectory.h"
+#include "TFile.h"
+#include "TH1.h"
+#include "TKey.h"
+#include "TROOT.h"
+
+#include "MiniCSCMacros.h"
+
+namespace {
+/// Histograms of one partial merge, by full path within the file
+using HistMap = std::map<std::string, std::unique_ptr<TH1>>;
+
+/// Adds other into merged. Returns false if the binning does not match.
+bool addHist(const std::string& path, TH1* merged, const TH1* other)
+{
+    if (path.rfind("/Mask/", 0) == 0) {
+        if (merged->GetNcells() != other->GetNcells()) return false;
+        for (int bin = 0; bin < merged->GetNcells(); bin++) {
+            merged->SetBinContent(bin, std::max(merged->GetBinContent(bin), other->GetBinContent(bin)));
+        }
+        return true;
+    }
+    return merged->Add(other);
+}
+
+/// Adds every histogram below dir into hists
+void collect(TDirectory* dir, const std::string& path, HistMap& hists)
+{
+    TIter next(dir->GetListOfKeys());
+    while (TKey* key = static_cast<TKey*>(next())) {
+        const std::string name = path + key->GetName();
+        TClass* cls = TClass::GetClass(key->GetClassName());
+        if (!cls) continue;
+
+        if (cls->InheritsFrom(TDirectory::Class())) {
+            collect(static_cast<TDirectory*>(key->ReadObj()), name + "/", hists);
+        } else if (cls->InheritsFrom(TH1::Class())) {
+            std::unique_ptr<TH1> hist(static_cast<TH1*>(key->ReadObj()));
+            hist->SetDirectory(nullptr);
+            auto found = hists.find(name);
+            if (found == hists.end()) {
+                hists.emplace(name, std::move(hist));
+            } else if (!addHist(name, found->second.get(), hist.get())) {
+                std::cerr << "Skipping " << name << " of " << dir->GetFile()->GetName() << ", binning differs\n";
+            }
+        }
+    }
+}
+
+/// Adds every step-th file starting at first into hists
+void mergeShare(const std::vector<std::string>& files, size_t first, size_t step, HistMap& hists, size_t& numMerged)
+{
+    for (size_t i = first; i < files.size(); i += step) {
+        std::unique_ptr<TFile> file(TFile::Open(files[i].c_str(), "READ"));
+        if (!file || file->IsZombie()) {
+            std::cerr << "Could not open " << files[i] << ", skipping it\n";
+            continue;
+        }
+        collect(file.get(), "/", hists);
+        numMerged++;
+    }
+}
+} // namespace
+
+/// Merges the MiniCSC outputs listed in fileList into outputFile, see MiniCSCMacros.h
+void mergeMiniCSC(const char* outputFile, const char* fileList, int numThreads)
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::string> files;
+    std::ifstream list(fileList);
+    std::string line;
+    while (std::getline(list, line)) {
+        if (!line.empty() && line[0] != '#') files.push_back(line);
+    }
+    if (files.empty()) {
+        std::cerr << "No input files in " << fileList << std::endl;
+        return;
+    }
+
+    // One partial merge per thread
+    ROOT::EnableThreadSafety();
+    const size_t numShares = std::max<size_t>(1, std::min<size_t>(numThreads, files.size()));
+    std::vector<HistMap> shares(numShares);
+    std::vector<size_t> numMerged(numShares, 0);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < numShares; i++) {
+        threads.emplace_back(mergeShare, std::cref(files), i, numShares, std::ref(shares[i]), std::ref(numMerged[i]));
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    // Add the partial merges into the first one
+    HistMap& merged = shares[0];
+    for (size_t i = 1; i < numShares; i++) {
+        for (auto& entry : shares[i]) {
+            auto found = merged.find(entry.first);
+            if (found == merged.end()) {
+                merged.emplace(entry.first, std::move(entry.second));
+            } else if (!addHist(entry.first, found->second.get(), entry.second.get())) {
+                std::cerr << "Skipping part of " << entry.first << ", binning differs\n";
+            }
+        }
+    }
+
+    // Same folder layout as the inputs
+    std::unique_ptr<TFile> out(TFile::Open(outputFile, "RECREATE"));
+    if (!out || out->IsZombie()) {
+        std::cerr << "Could not create " << outputFile << std::endl;
+        return;
+    }
+    for (auto& entry : merged) {
+        const size_t slash = entry.first.rfind('/');
+        const std::string dir = entry.first.substr(1, slash > 0 ? slash - 1 : 0);
+        TDirectory* target = dir.empty() ? out.get() : out->mkdir(dir.c_str(), "", true);
+        target->cd();
+        entry.second->Write(entry.first.substr(slash + 1).c_str());
+    }
+    out->Close();
+
+    size_t total = 0;
+    for (size_t n : numMerged) {
+        total += n;
+    }
+    std::cout << "Merged " << total << " of " << files.size() << " files, " << merged.size() << " histograms, in "
+              << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s" << std::endl;
+}
@@ -0,0 +1,120 @@
+// Command line front end for the common MiniCSC plots, built with CMakeLists.txt next to this file.
+//
+//   miniCSCPlots fit [-l layer] [-r rebin] [-p plotDir] [-o results.csv] in1.root [in2.root ...]
+//   miniCSCPlots charge [-r rebin] -o out.pdf inputDir
+//   miniCSCPlots merge [-j threads] -o merged.root fileList.txt
+//
+// fit runs chargeFit on every file and writes one line per file (file, layer, both peaks and the fit quality), so a
+// whole scan can be fitted from a shell loop or batch job. charge is clusterChargeRebin and merge is mergeMiniCSC.
+// Everything runs in batch mode, plots only go to files.
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TF1.h"
+#include "TROOT.h"
+
+#include "MiniCSCMacros.h"
+
+namespace {
+void usage()
+{
+    std::cerr << "Usage:\n"
+              << "  miniCSCPlots fit [-l layer] [-r rebin] [-p plotDir] [-o results.csv] in.root...\n"
+              << "  miniCSCPlots charge [-r rebin] -o out.pdf inputDir\n"
+              << "  miniCSCPlots merge [-j threads] -o merged.root fileList.txt\n";
+    exit(1);
+}
+
+struct Options {
+    std::string mode, output, plotDir;
+    std::vector<std::string> inputs;
+    int layer = 3;
+    int rebin = 32;
+    int threads = std::thread::hardware_concurrency();
+};
+
+Options parse(int argc, char** argv)
+{
+    if (argc < 3) usage();
+    Options options;
+    options.mode = argv[1];
+    for (int i = 2; i < argc; i++) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "-o" && hasValue) {
+            options.output = argv[++i];
+        } else if (arg == "-p" && hasValue) {
+            options.plotDir = argv[++i];
+        } else if (arg == "-l" && hasValue) {
+            options.layer = atoi(argv[++i]);
+        } else if (arg == "-r" && hasValue) {
+            options.rebin = atoi(argv[++i]);
+        } else if (arg == "-j" && hasValue) {
+            options.threads = atoi(argv[++i]);
+        } else if (arg[0] == '-') {
+            usage();
+        } else {
+            options.inputs.push_back(arg);
+        }
+    }
+    if (options.inputs.empty() || (options.mode != "fit" && options.output.empty())) usage();
+    if ((options.mode == "charge" || options.mode == "merge") && options.inputs.size() != 1) usage();
+    return options;
+}
+
+/// File name without directory and extension
+std::string stem(const std::string& path)
+{
+    const size_t slash = path.rfind('/');
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    const size_t dot = name.rfind('.');
+    return dot == std::string::npos ? name : name.substr(0, dot);
+}
+
+int fit(const Options& options)
+{
+    std::ofstream file;
+    if (!options.output.empty()) file.open(options.output);
+    std::ostream& out = options.output.empty() ? std::cout : file;
+    out << "file,layer,mean1,sigma1,mean2,sigma2,chi2,ndf" << std::endl;
+
+    int numFailed = 0;
+    for (const std::string& input : options.inputs) {
+        const std::string plot = options.plotDir.empty()
+            ? std::string()
+            : options.plotDir + "/" + stem(input) + "_L" + std::to_string(options.layer) + ".pdf";
+        TF1* total = chargeFit(input.c_str(), options.layer, options.rebin, plot.empty() ? nullptr : plot.c_str());
+        if (!total) {
+            numFailed++;
+            continue;
+        }
+        out << input << "," << options.layer << "," << total->GetParameter(1) << "," << total->GetParameter(2) << ","
+            << total->GetParameter(4) << "," << total->GetParameter(5) << "," << total->GetChisquare() << ","
+            << total->GetNDF() << std::endl;
+    }
+    return numFailed > 0 ? 1 : 0;
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const Options options = parse(argc, argv);
+    // No windows, canvases are only saved
+    gROOT->SetBatch(true);
+
+    if (options.mode == "fit") {
+        return fit(options);
+    } else if (options.mode == "charge") {
+        clusterChargeRebin(options.inputs[0].c_str(), options.output.c_str(), options.rebin);
+    } else if (options.mode == "merge") {
+        mergeMiniCSC(options.output.c_str(), options.inputs[0].c_str(), options.threads);
+    } else {
+        usage();
+    }
+    return 0;
+}